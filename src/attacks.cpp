@@ -0,0 +1,182 @@
+#include <bit>
+
+#ifdef ATTACKS_HAS_PEXT
+    #include <cpuid.h>
+#endif
+
+#include "attacks.hpp"
+
+
+namespace Attacks
+{
+
+    // Slow ray walk, only used to fill the tables
+    [[nodiscard]] static Bitboard slidingAttacks(const Square square, const Bitboard occupied, const int (&directions)[4][2])
+    {
+        Bitboard attacks = 0ULL;
+
+        for (const auto& [fileStep, rankStep] : directions) {
+            int file = square % 8 + fileStep;
+            int rank = square / 8 + rankStep;
+
+            while (file >= 0 && file < 8 && rank >= 0 && rank < 8) {
+                const Bitboard position = 1ULL << (rank * 8 + file);
+                attacks |= position;
+
+                if (position & occupied)
+                    break;
+
+                file += fileStep;
+                rank += rankStep;
+            }
+        }
+
+        return attacks;
+    }
+
+
+    static void initMagics(Magic (&magics)[64], Bitboard* table, const int (&directions)[4][2])
+    {
+        // Seeds known to converge quickly, one per rank
+        constexpr uint64_t seeds[8] = {728, 10316, 55013, 32803, 12281, 15100, 16645, 255};
+
+        Bitboard occupancy[4096];
+        Bitboard reference[4096];
+        int epoch[4096] = {};
+        int attempt     = 0;
+
+        Bitboard* attacks = table;
+
+        for (int square = 0; square < 64; ++square) {
+            Magic& m = magics[square];
+
+            // Board edges are not relevant unless the slider stands on them
+            const Bitboard edges = ((0xffULL | 0xff00000000000000ULL) & ~(0xffULL << (square / 8 * 8))) |
+                                   ((0x101010101010101ULL | 0x8080808080808080ULL) & ~(0x101010101010101ULL << (square % 8)));
+
+            m.mask    = slidingAttacks(s_cast(Square, square), 0ULL, directions) & ~edges;
+            m.shift   = 64 - std::popcount(m.mask);
+            m.attacks = attacks;
+
+            // Enumerate every subset of the mask (Carry-Rippler)
+            int size      = 0;
+            Bitboard subset = 0ULL;
+            do {
+                occupancy[size] = subset;
+                reference[size] = slidingAttacks(s_cast(Square, square), subset, directions);
+                ++size;
+                subset = (subset - m.mask) & m.mask;
+            } while (subset);
+
+            if (backend == Backend::PEXT) {
+                for (int i = 0; i < size; ++i)
+                    m.attacks[m.index(occupancy[i])] = reference[i];
+
+                attacks += size;
+                continue;
+            }
+
+            Utils::PRNG rng{seeds[square / 8]};
+
+            for (int i = 0; i < size;) {
+                // Magics with few set bits are found much faster
+                do {
+                    m.magic = rng.sparse();
+                } while (std::popcount((m.magic * m.mask) >> 56) < 6);
+
+                ++attempt;
+
+                for (i = 0; i < size; ++i) {
+                    const unsigned idx = m.index(occupancy[i]);
+
+                    if (epoch[idx] < attempt) {
+                        epoch[idx]     = attempt;
+                        m.attacks[idx] = reference[i];
+                    }
+                    else if (m.attacks[idx] != reference[i]) {
+                        break;
+                    }
+                }
+            }
+
+            attacks += size;
+        }
+    }
+
+
+    Backend detectBackend()
+    {
+#ifdef ATTACKS_HAS_PEXT
+        unsigned eax, ebx, ecx, edx;
+
+        if (__get_cpuid_max(0, nullptr) < 7)
+            return Backend::MAGIC;
+
+        __cpuid_count(7, 0, eax, ebx, ecx, edx);
+        if (!(ebx & bit_BMI2))
+            return Backend::MAGIC;
+
+        // Zen 1/2 (family 0x17 and older) implement pext in microcode, hundreds of cycles
+        __cpuid(0, eax, ebx, ecx, edx);
+        const bool isAMD = (ebx == signature_AMD_ebx) && (ecx == signature_AMD_ecx) && (edx == signature_AMD_edx);
+
+        __cpuid(1, eax, ebx, ecx, edx);
+        const unsigned family = ((eax >> 8) & 0xf) + (((eax >> 8) & 0xf) == 0xf ? ((eax >> 20) & 0xff) : 0);
+
+        if (isAMD && family < 0x19)
+            return Backend::MAGIC;
+
+        return Backend::PEXT;
+#else
+        return Backend::MAGIC;
+#endif
+    }
+
+
+    const char* backendName()
+    {
+        return (backend == Backend::PEXT) ? "pext" : "magic";
+    }
+
+
+    void init()
+    {
+        init(detectBackend());
+    }
+
+
+    void init(Backend forcedBackend)
+    {
+        backend = forcedBackend;
+
+        constexpr int rookDirections[4][2]   = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+        constexpr int bishopDirections[4][2] = {{1, 1}, {-1, -1}, {1, -1}, {-1, 1}};
+
+        initMagics(rookMagics, rookTable, rookDirections);
+        initMagics(bishopMagics, bishopTable, bishopDirections);
+
+
+        for (int a = 0; a < 64; ++a) {
+            for (int b = 0; b < 64; ++b) {
+                const Square squareA = s_cast(Square, a);
+                const Square squareB = s_cast(Square, b);
+
+                between[a][b] = 0ULL;
+                line[a][b]    = 0ULL;
+
+                if (a == b)
+                    continue;
+
+                if (bishopAttacks(squareA, 0ULL) & (1ULL << b)) {
+                    between[a][b] = bishopAttacks(squareA, 1ULL << b) & bishopAttacks(squareB, 1ULL << a);
+                    line[a][b]    = (bishopAttacks(squareA, 0ULL) & bishopAttacks(squareB, 0ULL)) | (1ULL << a) | (1ULL << b);
+                }
+                else if (rookAttacks(squareA, 0ULL) & (1ULL << b)) {
+                    between[a][b] = rookAttacks(squareA, 1ULL << b) & rookAttacks(squareB, 1ULL << a);
+                    line[a][b]    = (rookAttacks(squareA, 0ULL) & rookAttacks(squareB, 0ULL)) | (1ULL << a) | (1ULL << b);
+                }
+            }
+        }
+    }
+
+}
@@ -0,0 +1,114 @@
+#pragma once
+#include <cstdint>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+    #define ATTACKS_HAS_PEXT
+#endif
+
+#include "utils.hpp"
+
+
+namespace Attacks
+{
+
+    /*
+        Slider backends
+
+        MAGIC: multiply and shift, runs everywhere
+        PEXT:  BMI2 parallel bit extract, picked at startup when the CPU has a fast pext
+    */
+
+    enum class Backend
+    {
+        MAGIC,
+        PEXT
+    };
+
+    inline Backend backend = Backend::MAGIC;
+
+
+    [[nodiscard]] inline uint64_t pext(uint64_t x, uint64_t mask)
+    {
+#ifdef ATTACKS_HAS_PEXT
+        // Emitted as raw asm so the generic build can still use it once CPUID allows it
+        uint64_t result;
+        asm("pextq %2, %1, %0" : "=r"(result) : "r"(x), "r"(mask));
+        return result;
+#else
+        uint64_t result = 0ULL;
+        for (uint64_t bit = 1ULL; mask; bit <<= 1, mask &= mask - 1) {
+            if (x & mask & -mask)
+                result |= bit;
+        }
+        return result;
+#endif
+    }
+
+
+    /*
+        Fancy magic bitboards
+
+        The relevant occupancy (mask) of a slider is hashed with a
+        multiply and a shift into a per-square slice of a shared table:
+
+            attacks[((occupied & mask) * magic) >> shift]
+
+        With the PEXT backend the same slices are indexed by pext(occupied, mask).
+    */
+
+    struct Magic
+    {
+        Bitboard mask     = 0ULL;
+        Bitboard magic    = 0ULL;
+        Bitboard* attacks = nullptr;
+        unsigned shift    = 0;
+
+        [[nodiscard]] inline unsigned index(Bitboard occupied) const
+        {
+            if (backend == Backend::PEXT)
+                return s_cast(unsigned, pext(occupied, mask));
+
+            return s_cast(unsigned, ((occupied & mask) * magic) >> shift);
+        }
+    };
+
+
+    inline Magic rookMagics[64];
+    inline Magic bishopMagics[64];
+
+    inline Bitboard rookTable[0x19000];
+    inline Bitboard bishopTable[0x1480];
+
+
+    // Squares strictly between two aligned squares, 0 if not aligned
+    inline Bitboard between[64][64];
+
+    // Full board line through two aligned squares, 0 if not aligned
+    inline Bitboard line[64][64];
+
+
+    [[nodiscard]] Backend detectBackend();
+    [[nodiscard]] const char* backendName();
+
+    void init();
+    void init(Backend forcedBackend);
+
+
+    [[nodiscard]] inline Bitboard bishopAttacks(const Square square, const Bitboard occupied)
+    {
+        const Magic& m = bishopMagics[square];
+        return m.attacks[m.index(occupied)];
+    }
+
+    [[nodiscard]] inline Bitboard rookAttacks(const Square square, const Bitboard occupied)
+    {
+        const Magic& m = rookMagics[square];
+        return m.attacks[m.index(occupied)];
+    }
+
+    [[nodiscard]] inline Bitboard queenAttacks(const Square square, const Bitboard occupied)
+    {
+        return bishopAttacks(square, occupied) | rookAttacks(square, occupied);
+    }
+
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+#include "threads.hpp"
+
+
+namespace Bench
+{
+
+    /*
+        Fixed search benchmark
+
+        Searches every position of a fixed suite to the same depth, with
+        the hash and move ordering history cleared first. With one thread
+        the node counts and best moves only change when the search does,
+        so their signature tells an intended speedup apart from a change
+        in behaviour. More threads give a speed figure only.
+    */
+
+    constexpr int defaultDepth = 12;
+
+    struct Result
+    {
+        uint64_t nodes       = 0;
+        int64_t microseconds = 0;
+        uint64_t signature   = 0; // Node count and best move of every position, hashed
+    };
+
+    // Leaves the thread count and hash size as they were
+    [[nodiscard]] Result run(ThreadPool& threads, int depth, int threadCount, int hashSize);
+
+}
@@ -41,5 +41,73 @@ void Board::precomputeMoves()
         precomputedMoves.kingMoves[i] |= (position & Utils::BitMaskB) >> 7;
         precomputedMoves.kingMoves[i] |= (position) >> 8;
         precomputedMoves.kingMoves[i] |= (position & Utils::BitMaskA) >> 9;
+
+
+        // Pawn captures
+        precomputedMoves.pawnAttacks[1][i] |= (position & Utils::BitMaskB) << 9;
+        precomputedMoves.pawnAttacks[1][i] |= (position & Utils::BitMaskA) << 7;
+        precomputedMoves.pawnAttacks[0][i] |= (position & Utils::BitMaskA) >> 9;
+        precomputedMoves.pawnAttacks[0][i] |= (position & Utils::BitMaskB) >> 7;
     }
 }
+
+
+void Board::putPiece(const int piece, const Square square)
+{
+    const Bitboard position = 1ULL << square;
+
+    bitboards[piece] |= position;
+    occupiedSquares[Utils::isPieceWhite(piece)] |= position;
+    mailbox[square] = piece;
+
+    key ^= Zobrist::piece(piece, square);
+
+    if ((piece >> 1) == Pieces::PieceType::PAWN)
+        pawnKey ^= Zobrist::piece(piece, square);
+
+    const Eval::Terms& terms = Eval::piece(piece, square);
+    eval.mg += terms.mg;
+    eval.eg += terms.eg;
+    eval.phase += terms.phase;
+}
+
+
+void Board::removePiece(const Square square)
+{
+    const int piece         = mailbox[square];
+    const Bitboard position = 1ULL << square;
+
+    bitboards[piece] &= ~position;
+    occupiedSquares[Utils::isPieceWhite(piece)] &= ~position;
+    mailbox[square] = Pieces::Piece::NONE;
+
+    key ^= Zobrist::piece(piece, square);
+
+    if ((piece >> 1) == Pieces::PieceType::PAWN)
+        pawnKey ^= Zobrist::piece(piece, square);
+
+    const Eval::Terms& terms = Eval::piece(piece, square);
+    eval.mg -= terms.mg;
+    eval.eg -= terms.eg;
+    eval.phase -= terms.phase;
+}
+
+
+void Board::movePiece(const Square fromSquare, const Square toSquare)
+{
+    const int piece          = mailbox[fromSquare];
+    const Bitboard fromToPos = (1ULL << fromSquare) | (1ULL << toSquare);
+
+    bitboards[piece] ^= fromToPos;
+    occupiedSquares[Utils::isPieceWhite(piece)] ^= fromToPos;
+    mailbox[fromSquare] = Pieces::Piece::NONE;
+    mailbox[toSquare]   = piece;
+
+    key ^= Zobrist::piece(piece, fromSquare) ^ Zobrist::piece(piece, toSquare);
+
+    if ((piece >> 1) == Pieces::PieceType::PAWN)
+        pawnKey ^= Zobrist::piece(piece, fromSquare) ^ Zobrist::piece(piece, toSquare);
+
+    eval.mg += Eval::piece(piece, toSquare).mg - Eval::piece(piece, fromSquare).mg;
+    eval.eg += Eval::piece(piece, toSquare).eg - Eval::piece(piece, fromSquare).eg;
+}
@@ -3,6 +3,8 @@
 
 #include "utils.hpp"
 #include "pieces.hpp"
+#include "zobrist.hpp"
+#include "evaluate.hpp"
 
 
 typedef std::array<Bitboard, Pieces::Piece::PIECE_COUNT> BitboardArray;
@@ -16,29 +18,21 @@ struct Board
     {
         Bitboard knightMoves[64] = {};
         Bitboard kingMoves[64]   = {};
+
+        // Captures only, [0]: Black, [1]: White
+        Bitboard pawnAttacks[2][64] = {};
     } precomputedMoves;
 
 
+    // Only what makeMove can't reverse on its own
     struct HistoryState
     {
-        BitboardArray bitboards = {};
-        Mailbox mailbox         = {};
+        Pieces::Move move = {};
+        int capturedPiece = Pieces::Piece::NONE;
 
-        Square enPassantSquare = 0;
+        Square enPassantSquare = 64;
         char castlingFlags     = 0;
-
-        Bitboard occupiedSquares[2] = {0ULL, 0ULL};
-
-        HistoryState() = default;
-        HistoryState(const Board& board)
-            : bitboards(board.bitboards),
-              mailbox(board.mailbox),
-
-              enPassantSquare(board.enPassantSquare),
-              castlingFlags(board.castlingFlags),
-
-              occupiedSquares{board.occupiedSquares[0], board.occupiedSquares[1]}
-        {}
+        int halfmoveClock      = 0;
     };
 
 
@@ -52,6 +46,18 @@ struct Board
 
     int plyCount = 0;
 
+    // Plies since the last capture or pawn move, for the 50-move rule
+    int halfmoveClock = 0;
+
+    // Zobrist key, kept up to date by the piece helpers and makeMove/undoMove
+    uint64_t key = 0ULL;
+
+    // Same, over the pawns only, for the pawn hash
+    uint64_t pawnKey = 0ULL;
+
+    // Material, piece-square and phase sums, kept up to date by the piece helpers
+    Eval::Terms eval = {};
+
     char castlingFlags     = 0;
     Square enPassantSquare = 64;
 
@@ -65,4 +71,8 @@ struct Board
     Bitboard occupiedSquares[2] = {0ULL, 0ULL};
 
     void precomputeMoves();
+
+    void putPiece(const int piece, const Square square);
+    void removePiece(const Square square);
+    void movePiece(const Square fromSquare, const Square toSquare);
 };
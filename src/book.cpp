@@ -0,0 +1,248 @@
+#include <sstream>
+
+#include "book.hpp"
+
+
+namespace Book
+{
+
+    [[nodiscard]] static uint64_t readBE(const uint8_t* data, const int bytes)
+    {
+        uint64_t value = 0ULL;
+
+        for (int i = 0; i < bytes; ++i)
+            value = (value << 8) | data[i];
+
+        return value;
+    }
+
+
+    uint64_t key(const Engine& engine)
+    {
+        const Board& board = engine.board;
+        uint64_t key       = 0ULL;
+
+        for (Square square = 0; square < 64; ++square) {
+            const int piece = board.mailbox[square];
+
+            if (piece == Pieces::Piece::NONE)
+                continue;
+
+            // Book kinds alternate Black, White per type
+            const int kind = 2 * (piece >> 1) + !(piece & 1);
+
+            key ^= randoms[64 * kind + square];
+        }
+
+        constexpr int castlingRights[4] = {
+            Utils::CastlingRightsFlags::W_KINGSIDE,
+            Utils::CastlingRightsFlags::W_QUEENSIDE,
+            Utils::CastlingRightsFlags::B_KINGSIDE,
+            Utils::CastlingRightsFlags::B_QUEENSIDE
+        };
+
+        for (int i = 0; i < 4; ++i) {
+            if (board.castlingFlags & castlingRights[i])
+                key ^= randoms[castlingOffset + i];
+        }
+
+        // En passant only counts if a pawn of the side to move stands next to the pawn that can be taken
+        if (board.enPassantSquare != 64) {
+            const int file        = board.enPassantSquare & 7;
+            const int pawnRank    = engine.isWhiteTurn ? 4 : 3;
+            const int capturePawn = engine.isWhiteTurn ? Pieces::Piece::W_PAWN : Pieces::Piece::B_PAWN;
+
+            const bool canCapture = (file > 0 && board.mailbox[pawnRank * 8 + file - 1] == capturePawn) ||
+                                    (file < 7 && board.mailbox[pawnRank * 8 + file + 1] == capturePawn);
+
+            if (canCapture)
+                key ^= randoms[enPassantOffset + file];
+        }
+
+        if (engine.isWhiteTurn)
+            key ^= randoms[turnOffset];
+
+        return key;
+    }
+
+
+    bool checkKeys()
+    {
+        struct Reference
+        {
+            const char* moves; // From the start position
+            uint64_t key;
+        };
+
+        constexpr Reference references[] = {
+            {"",                                   0x463B96181691FC9CULL},
+            {"e2e4",                               0x823C9B50FD114196ULL},
+            {"e2e4 d7d5",                          0x0756B94461C50FB0ULL},
+            {"e2e4 d7d5 e4e5",                     0x662FAFB965DB29D4ULL},
+            {"e2e4 d7d5 e4e5 f7f5",                0x22A48B5A8E47FF78ULL},
+            {"e2e4 d7d5 e4e5 f7f5 e1e2",           0x652A607CA3F242C1ULL},
+            {"e2e4 d7d5 e4e5 f7f5 e1e2 e8f7",      0x00FDD303C946BDD9ULL},
+            {"a2a4 b7b5 h2h4 b5b4 c2c4",           0x3C8123EA7B067637ULL},
+            {"a2a4 b7b5 h2h4 b5b4 c2c4 b4c3 a1a3", 0x5C3F9B829B279560ULL}
+        };
+
+        Engine engine;
+        bool passed = true;
+
+        for (const Reference& reference : references) {
+            engine.loadFEN({"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR", "w", "KQkq", "-", "0", "1"});
+
+            std::istringstream stream(reference.moves);
+
+            for (std::string move; stream >> move;)
+                engine.makeUCIMove(move);
+
+            const uint64_t found = key(engine);
+
+            if (found != reference.key) {
+                std::cout << "info string book key mismatch after \"" << reference.moves << "\": " << std::hex << found
+                          << " instead of " << reference.key << std::dec << std::endl;
+                passed = false;
+            }
+        }
+
+        return passed;
+    }
+
+
+    uint16_t encodeMove(const Pieces::Move& move)
+    {
+        int to = move.to();
+
+        // King takes rook: g-file castling to the h-file, c-file to the a-file
+        if (move.isCastle())
+            to += ((to & 7) == 6) ? 1 : -2;
+
+        const int promotion = move.isPromotion() ? move.promotionPieceType() : 0;
+
+        return s_cast(uint16_t, to | (move.from() << 6) | (promotion << 12));
+    }
+
+
+    Pieces::Move decodeMove(const Engine& engine, const uint16_t bookMove)
+    {
+        const Engine::MoveList moves = engine.generateAllMoves();
+
+        for (int i = 0; i < moves.used; ++i) {
+            if (encodeMove(moves.moves[i]) == bookMove)
+                return moves.moves[i];
+        }
+
+        return Pieces::Move{};
+    }
+
+
+    bool OpeningBook::load(const std::string& filePath, std::string& error)
+    {
+        Mapping::File newFile;
+
+        if (!newFile.open(filePath)) {
+            error = "can't open " + filePath;
+            return false;
+        }
+
+        if (newFile.size % entrySize) {
+            newFile.close();
+            error = filePath + ": not a Polyglot book";
+            return false;
+        }
+
+        unload();
+
+        file   = newFile;
+        path   = filePath;
+        loaded = true;
+
+        return true;
+    }
+
+
+    void OpeningBook::unload()
+    {
+        file.close();
+
+        loaded = false;
+        path   = "";
+    }
+
+
+    Entry OpeningBook::entry(const std::size_t index) const
+    {
+        const uint8_t* data = file.data + index * entrySize;
+
+        return Entry{
+            .key    = readBE(data, 8),
+            .move   = s_cast(uint16_t, readBE(data + 8, 2)),
+            .weight = s_cast(uint16_t, readBE(data + 10, 2)),
+            .learn  = s_cast(uint32_t, readBE(data + 12, 4))
+        };
+    }
+
+
+    Pieces::Move OpeningBook::probe(const Engine& engine)
+    {
+        if (!loaded)
+            return Pieces::Move{};
+
+        const uint64_t positionKey = key(engine);
+
+        // First entry with the key
+        std::size_t low  = 0;
+        std::size_t high = size();
+
+        while (low < high) {
+            const std::size_t middle = low + (high - low) / 2;
+
+            if (entry(middle).key < positionKey)
+                low = middle + 1;
+            else
+                high = middle;
+        }
+
+        Pieces::Move moves[256];
+        uint32_t weights[256];
+        int count          = 0;
+        uint32_t weightSum = 0;
+
+        for (std::size_t i = low; i < size() && count < 256; ++i) {
+            const Entry bookEntry = entry(i);
+
+            if (bookEntry.key != positionKey)
+                break;
+
+            // Zero weight marks a move never to be played, also skip moves from a key collision
+            const Pieces::Move move = decodeMove(engine, bookEntry.move);
+
+            if (!bookEntry.weight || move.isNull())
+                continue;
+
+            moves[count]   = move;
+            weights[count] = bookEntry.weight;
+            weightSum += bookEntry.weight;
+            ++count;
+        }
+
+        if (!count)
+            return Pieces::Move{};
+
+        if (bestMove)
+            return moves[std::max_element(weights, weights + count) - weights];
+
+        uint64_t pick = rng.next() % weightSum;
+
+        for (int i = 0; i < count; ++i) {
+            if (pick < weights[i])
+                return moves[i];
+
+            pick -= weights[i];
+        }
+
+        return moves[count - 1];
+    }
+
+}
@@ -0,0 +1,484 @@
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "book.hpp"
+
+
+namespace Book
+{
+
+    Pieces::Move parseSAN(const Engine& engine, std::string_view san)
+    {
+        // Check marks and annotations don't identify the move
+        while (!san.empty() && std::string_view("+#!?").find(san.back()) != std::string_view::npos)
+            san.remove_suffix(1);
+
+        const Engine::MoveList moves = engine.generateAllMoves();
+
+        if (san == "O-O" || san == "0-0" || san == "O-O-O" || san == "0-0-0") {
+            const int toFile = (san.size() == 3) ? 6 : 2;
+
+            for (int i = 0; i < moves.used; ++i) {
+                if (moves.moves[i].isCastle() && (moves.moves[i].to() & 7) == toFile)
+                    return moves.moves[i];
+            }
+
+            return Pieces::Move{};
+        }
+
+        // Piece letter, disambiguation, optional 'x', target square, optional promotion
+        int pieceType = Pieces::PieceType::PAWN;
+
+        if (!san.empty() && std::string_view("NBRQK").find(san[0]) != std::string_view::npos) {
+            pieceType = Pieces::PieceType::KNIGHT + s_cast(int, std::string_view("NBRQK").find(san[0]));
+            san.remove_prefix(1);
+        }
+
+        int promotionType = Pieces::PieceType::PIECE_TYPE_COUNT;
+
+        if (!san.empty() && std::string_view("NBRQ").find(san.back()) != std::string_view::npos) {
+            promotionType = Pieces::PieceType::KNIGHT + s_cast(int, std::string_view("NBRQ").find(san.back()));
+            san.remove_suffix(1);
+
+            if (!san.empty() && san.back() == '=')
+                san.remove_suffix(1);
+        }
+
+        if (san.size() < 2)
+            return Pieces::Move{};
+
+        const char toFileChar = san[san.size() - 2];
+        const char toRankChar = san[san.size() - 1];
+
+        if (toFileChar < 'a' || toFileChar > 'h' || toRankChar < '1' || toRankChar > '8')
+            return Pieces::Move{};
+
+        const int to = (toRankChar - '1') * 8 + (toFileChar - 'a');
+
+        int fromFile = -1;
+        int fromRank = -1;
+
+        for (const char c : san.substr(0, san.size() - 2)) {
+            if (c >= 'a' && c <= 'h')
+                fromFile = c - 'a';
+            else if (c >= '1' && c <= '8')
+                fromRank = c - '1';
+            else if (c != 'x')
+                return Pieces::Move{};
+        }
+
+        Pieces::Move found = {};
+
+        for (int i = 0; i < moves.used; ++i) {
+            const Pieces::Move& move = moves.moves[i];
+
+            if (move.to() != to || move.isCastle() || (engine.board.mailbox[move.from()] >> 1) != pieceType ||
+                move.promotionPieceType() != promotionType)
+                continue;
+
+            if ((fromFile != -1 && (move.from() & 7) != fromFile) || (fromRank != -1 && (move.from() >> 3) != fromRank))
+                continue;
+
+            // Ambiguous
+            if (!found.isNull())
+                return Pieces::Move{};
+
+            found = move;
+        }
+
+        return found;
+    }
+
+
+    /*
+        Book building
+
+        The PGN file is memory mapped and cut into one byte range per
+        thread, each thread takes the games whose [Event tag starts in its
+        range. Moves are counted in thread local batches and merged into a
+        hash map split in shards by key, each with its own lock, so threads
+        rarely wait on each other. Keys and entries are standard Polyglot,
+        the book can be read by any Polyglot tool.
+    */
+
+    constexpr int shardCount        = 64;
+    constexpr std::size_t batchSize = 1 << 16; // Records a thread collects before merging them
+
+    struct MoveKey
+    {
+        uint64_t key  = 0ULL;
+        uint16_t move = 0;
+
+        bool operator==(const MoveKey&) const = default;
+    };
+
+    struct MoveKeyHash
+    {
+        std::size_t operator()(const MoveKey& moveKey) const
+        {
+            return s_cast(std::size_t, moveKey.key ^ (moveKey.move * 0x9E3779B97F4A7C15ULL));
+        }
+    };
+
+    struct Stats
+    {
+        uint32_t games  = 0;
+        uint32_t points = 0; // 2 per win and 1 per draw for the side that played the move
+    };
+
+    struct Shard
+    {
+        std::mutex mutex;
+        std::unordered_map<MoveKey, Stats, MoveKeyHash> moves;
+    };
+
+    struct Record
+    {
+        MoveKey moveKey = {};
+        uint8_t points  = 0;
+    };
+
+
+    [[nodiscard]] static int shardOf(const uint64_t key)
+    {
+        return s_cast(int, key >> 58);
+    }
+
+
+    // Start of the first game at or after position, games start with an [Event tag on a new line
+    [[nodiscard]] static const char* nextGame(const char* position, const char* begin, const char* end)
+    {
+        const std::string_view tag = "[Event ";
+
+        for (; position < end; ++position) {
+            if (*position == '[' && (position == begin || position[-1] == '\n') &&
+                std::string_view(position, std::min<std::size_t>(tag.size(), end - position)) == tag)
+                return position;
+        }
+
+        return end;
+    }
+
+
+    // One per thread
+    struct Builder
+    {
+        Builder(const MakeOptions& options, Shard* shards) : options(options), shards(shards) {}
+
+        // Games from begin up to the game starting at or after rangeEnd
+        void run(const char* fileBegin, const char* rangeBegin, const char* rangeEnd, const char* fileEnd)
+        {
+            engine.loadFEN({"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR", "w", "KQkq", "-", "0", "1"});
+
+            const char* game = nextGame(rangeBegin, fileBegin, fileEnd);
+
+            while (game < rangeEnd) {
+                const char* gameEnd = nextGame(game + 1, fileBegin, fileEnd);
+
+                parseGame(game, gameEnd);
+                game = gameEnd;
+            }
+
+            flush();
+        }
+
+        uint64_t games   = 0;
+        uint64_t skipped = 0; // Games from a set up position or with a move that didn't parse
+
+        const MakeOptions& options;
+        Shard* shards;
+
+        Engine engine;
+        std::vector<Record> batch;
+
+        // The game's moves, credited once the result is known
+        MoveKey gameMoves[Settings::maxPly];
+        bool gameMoveWhite[Settings::maxPly];
+
+
+        void parseGame(const char* p, const char* end)
+        {
+            int whitePoints = -1; // 2 win, 1 draw, 0 loss for White, -1 unknown
+            bool isSetUp    = false;
+
+            const auto resultPoints = [](const std::string_view result) {
+                return (result == "1-0") ? 2 : (result == "0-1") ? 0 : (result == "1/2-1/2") ? 1 : -1;
+            };
+
+            // Tag pairs
+            while (true) {
+                while (p < end && std::isspace(s_cast(unsigned char, *p)))
+                    ++p;
+
+                if (p >= end || *p != '[')
+                    break;
+
+                const char* lineEnd = std::find(p, end, '\n');
+                const std::string_view line(p, lineEnd - p);
+
+                if (line.starts_with("[FEN "))
+                    isSetUp = true;
+
+                if (line.starts_with("[Result \"")) {
+                    const std::size_t quote = line.find('"', 9);
+
+                    if (quote != std::string_view::npos)
+                        whitePoints = resultPoints(line.substr(9, quote - 9));
+                }
+
+                p = lineEnd;
+            }
+
+            if (isSetUp) {
+                ++skipped;
+                return;
+            }
+
+            // Movetext
+            int plies    = 0;
+            bool isValid = true;
+
+            while (p < end && isValid) {
+                const char c = *p;
+
+                if (std::isspace(s_cast(unsigned char, c))) {
+                    ++p;
+                }
+                else if (c == '{') {
+                    p = std::find(p, end, '}');
+                    p += (p < end);
+                }
+                else if (c == ';' || c == '%') {
+                    p = std::find(p, end, '\n');
+                }
+                else if (c == '(') {
+                    // Variations may nest and hold comments with parentheses
+                    int nesting = 0;
+
+                    for (; p < end; ++p) {
+                        if (*p == '{') {
+                            p = std::find(p, end, '}');
+
+                            // Unclosed comment runs to the end of the game
+                            if (p == end)
+                                break;
+                        }
+                        else if (*p == '(')
+                            ++nesting;
+                        else if (*p == ')' && --nesting == 0)
+                            break;
+                    }
+
+                    p += (p < end);
+                }
+                else {
+                    const char* tokenEnd = p;
+
+                    while (tokenEnd < end && !std::isspace(s_cast(unsigned char, *tokenEnd)) &&
+                           std::string_view("{(;").find(*tokenEnd) == std::string_view::npos)
+                        ++tokenEnd;
+
+                    std::string_view token(p, tokenEnd - p);
+                    p = tokenEnd;
+
+                    const int points = resultPoints(token);
+
+                    if (points != -1 || token == "*") {
+                        if (whitePoints == -1)
+                            whitePoints = points;
+                        break;
+                    }
+
+                    // Move numbers, "12." and "12..." or glued to the move as in "12.e4"
+                    const std::size_t dot = token.find_last_of('.');
+
+                    if (dot != std::string_view::npos)
+                        token.remove_prefix(dot + 1);
+
+                    if (token.empty() || token[0] == '$' || token[0] == ')')
+                        continue;
+
+                    if (plies >= std::min(options.maxPlies, Settings::maxPly))
+                        break;
+
+                    const Pieces::Move move = parseSAN(engine, token);
+
+                    if (move.isNull()) {
+                        isValid = false;
+                        break;
+                    }
+
+                    gameMoves[plies]     = MoveKey{key(engine), encodeMove(move)};
+                    gameMoveWhite[plies] = engine.isWhiteTurn;
+                    ++plies;
+
+                    engine.makeMove(move);
+                }
+            }
+
+            for (int i = 0; i < plies; ++i)
+                engine.undoMove();
+
+            if (!isValid) {
+                ++skipped;
+                return;
+            }
+
+            ++games;
+
+            // Unfinished games count as draws
+            if (whitePoints == -1)
+                whitePoints = 1;
+
+            for (int i = 0; i < plies; ++i) {
+                batch.push_back(Record{gameMoves[i], s_cast(uint8_t, gameMoveWhite[i] ? whitePoints : 2 - whitePoints)});
+
+                if (batch.size() >= batchSize)
+                    flush();
+            }
+        }
+
+
+        void flush()
+        {
+            std::sort(batch.begin(), batch.end(), [](const Record& a, const Record& b) {
+                return shardOf(a.moveKey.key) < shardOf(b.moveKey.key);
+            });
+
+            for (std::size_t i = 0; i < batch.size();) {
+                const int shardIndex = shardOf(batch[i].moveKey.key);
+                Shard& shard         = shards[shardIndex];
+
+                std::lock_guard<std::mutex> lock(shard.mutex);
+
+                for (; i < batch.size() && shardOf(batch[i].moveKey.key) == shardIndex; ++i) {
+                    Stats& stats = shard.moves[batch[i].moveKey];
+
+                    ++stats.games;
+                    stats.points += batch[i].points;
+                }
+            }
+
+            batch.clear();
+        }
+    };
+
+
+    static void writeBE(uint8_t* data, const uint64_t value, const int bytes)
+    {
+        for (int i = 0; i < bytes; ++i)
+            data[i] = s_cast(uint8_t, value >> (8 * (bytes - 1 - i)));
+    }
+
+
+    bool make(const std::string& pgnPath, const std::string& bookPath, const MakeOptions& options, std::string& error)
+    {
+        const int64_t start = Utils::now();
+
+        Mapping::File pgn;
+
+        if (!pgn.open(pgnPath)) {
+            error = "can't open " + pgnPath;
+            return false;
+        }
+
+        const char* begin = reinterpret_cast<const char*>(pgn.data);
+        const char* end   = begin + pgn.size;
+
+        const int threadCount = std::max(options.threads, 1);
+
+        auto shards = std::make_unique<Shard[]>(shardCount);
+
+        std::vector<std::unique_ptr<Builder>> builders;
+        std::vector<std::thread> threads;
+
+        for (int i = 0; i < threadCount; ++i) {
+            builders.push_back(std::make_unique<Builder>(options, shards.get()));
+
+            const char* rangeBegin = begin + pgn.size * i / threadCount;
+            const char* rangeEnd   = begin + pgn.size * (i + 1) / threadCount;
+
+            threads.emplace_back(&Builder::run, builders.back().get(), begin, rangeBegin, rangeEnd, end);
+        }
+
+        for (std::thread& thread : threads)
+            thread.join();
+
+        pgn.close();
+
+
+        // Weights are the points of each move, scaled down per position if they don't fit 16 bits
+        struct Scored
+        {
+            MoveKey moveKey = {};
+            uint64_t points = 0;
+        };
+
+        std::vector<Scored> entries;
+
+        for (int i = 0; i < shardCount; ++i) {
+            for (const auto& [moveKey, stats] : shards[i].moves) {
+                if (stats.games >= s_cast(uint32_t, options.minGames) && stats.points)
+                    entries.push_back(Scored{moveKey, stats.points});
+            }
+
+            shards[i].moves = {};
+        }
+
+        std::sort(entries.begin(), entries.end(), [](const Scored& a, const Scored& b) {
+            if (a.moveKey.key != b.moveKey.key)
+                return a.moveKey.key < b.moveKey.key;
+
+            return (a.points != b.points) ? a.points > b.points : a.moveKey.move < b.moveKey.move;
+        });
+
+        std::vector<uint8_t> data(entries.size() * entrySize);
+        uint64_t maxPoints = 0;
+
+        for (std::size_t i = 0; i < entries.size(); ++i) {
+            const Scored& entry = entries[i];
+
+            // The first entry of a position has the most points
+            if (i == 0 || entries[i - 1].moveKey.key != entry.moveKey.key)
+                maxPoints = entry.points;
+
+            const uint64_t weight = (maxPoints > 0xFFFF) ? std::max<uint64_t>(entry.points * 0xFFFF / maxPoints, 1) : entry.points;
+
+            uint8_t* out = data.data() + i * entrySize;
+
+            writeBE(out, entry.moveKey.key, 8);
+            writeBE(out + 8, entry.moveKey.move, 2);
+            writeBE(out + 10, weight, 2);
+            writeBE(out + 12, 0, 4);
+        }
+
+        std::ofstream file(bookPath, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(data.data()), s_cast(std::streamsize, data.size()));
+
+        if (!file) {
+            error = "can't write " + bookPath;
+            return false;
+        }
+
+        uint64_t games   = 0;
+        uint64_t skipped = 0;
+
+        for (const auto& builder : builders) {
+            games += builder->games;
+            skipped += builder->skipped;
+        }
+
+        std::cout << "info string makebook " << games << " games (" << skipped << " skipped), " << entries.size() << " entries, "
+                  << (Utils::now() - start) << " ms" << std::endl;
+
+        return true;
+    }
+
+}
@@ -1,5 +1,14 @@
 #include "engine.hpp"
 #include "board.cpp"
+#include "attacks.cpp"
+#include "transposition.cpp"
+#include "timeman.cpp"
+#include "pawns.cpp"
+#include "mapping.cpp"
+#include "nnue.cpp"
+#include "syzygy.cpp"
+#include "book.cpp"
+#include "bookmaker.cpp"
 
 
 Engine::Engine()
@@ -96,8 +105,16 @@ void Engine::loadFEN(const std::vector<std::string>& FEN)
     board.occupiedSquares[0] = 0ULL;
     board.occupiedSquares[1] = 0ULL;
 
+    board.history.used  = 0;
+    board.plyCount      = 0;
+    board.halfmoveClock = 0;
 
-    board.castlingFlags = 0;
+    accumulatorIndex = 0;
+    resetAccumulators();
+
+
+    board.castlingFlags   = 0;
+    board.enPassantSquare = 64;
 
 
     for (const char& c : FEN[0]) {
@@ -137,297 +154,387 @@ void Engine::loadFEN(const std::vector<std::string>& FEN)
 
     if (FEN[3] != "-")
         board.enPassantSquare = Utils::squareFromUCI(FEN[3]);
+
+    if (FEN.size() > 4)
+        board.halfmoveClock = std::max(std::stoi(FEN[4]), 0);
+
+
+    board.key     = computeKey();
+    board.pawnKey = computePawnKey();
+    board.eval    = computeEvalTerms();
 }
 
 
-int Engine::evaluateBoard() const
+uint64_t Engine::computeKey() const
 {
-    int score = 0;
+    uint64_t key = 0ULL;
 
-    for (int i = 0; i < Pieces::Piece::PIECE_COUNT; ++i) {
-        const bool isPieceWhite = Utils::isPieceWhite(i);
-        // score += std::popcount(board.bitboards[i]) * (isPieceWhite - !isPieceWhite);
-        score += std::popcount(board.bitboards[i]) * (isPieceWhite ? 1 : -1);
+    for (int square = 0; square < 64; ++square) {
+        if (board.mailbox[square] != Pieces::Piece::NONE)
+            key ^= Zobrist::piece(board.mailbox[square], square);
     }
 
-    // return score * (isWhiteTurn - !isWhiteTurn);
-    return score * (isWhiteTurn ? 1 : -1);
+    key ^= Zobrist::castling(board.castlingFlags);
+    key ^= Zobrist::enPassant(board.enPassantSquare);
+
+    if (!isWhiteTurn)
+        key ^= Zobrist::keys.blackToMove;
+
+    return key;
 }
 
 
-Bitboard Engine::generatePieceMoves(const Square& square, const int& piece) const
+uint64_t Engine::computePawnKey() const
 {
-    const Bitboard occupiedSquaresAll = (board.occupiedSquares[0] | board.occupiedSquares[1]);
+    uint64_t key = 0ULL;
 
-    const Bitboard position = (1ULL << square);
+    for (int square = 0; square < 64; ++square) {
+        if ((board.mailbox[square] >> 1) == Pieces::PieceType::PAWN)
+            key ^= Zobrist::piece(board.mailbox[square], square);
+    }
 
-    const Bitboard enPassantPos = (board.enPassantSquare == 64) ? 0ULL : (1ULL << board.enPassantSquare);
+    return key;
+}
 
 
-    /*
-         Bitshift offsets
+Eval::Terms Engine::computeEvalTerms() const
+{
+    Eval::Terms terms;
 
-        << 7 | << 8 | << 9
-        -----|------|-----
-        << 1 |   0  | >> 1
-        -----|------|-----
-        >> 9 | >> 8 | >> 7
-    */
+    for (int square = 0; square < 64; ++square) {
+        if (board.mailbox[square] != Pieces::Piece::NONE) {
+            const Eval::Terms& piece = Eval::piece(board.mailbox[square], square);
 
+            terms.mg += piece.mg;
+            terms.eg += piece.eg;
+            terms.phase += piece.phase;
+        }
+    }
 
-    switch (piece) {
-        case Pieces::Piece::W_PAWN: {
-            Bitboard moves = 0ULL;
+    return terms;
+}
 
-            moves |= (position << 8) & ~occupiedSquaresAll;
-            moves |= (position << 7) & Utils::BitMaskB & (board.occupiedSquares[0] | enPassantPos);
-            moves |= (position << 9) & Utils::BitMaskA & (board.occupiedSquares[0] | enPassantPos);
 
-            // Double push if possible
-            if ((position & Utils::W_PawnStart) && ((position << 8) & ~occupiedSquaresAll))
-                moves |= (position << 16) & ~occupiedSquaresAll;
+void Engine::verifyKey() const
+{
+    const uint64_t expected = computeKey();
 
-            return moves;
-        }
-        case Pieces::Piece::B_PAWN: {
-            Bitboard moves = 0ULL;
+    if (board.key != expected) {
+        std::cout << "info string zobrist mismatch: incremental " << board.key << ", recomputed " << expected << std::endl;
+        std::abort();
+    }
 
-            moves |= (position >> 8) & ~occupiedSquaresAll;
-            moves |= (position >> 7) & Utils::BitMaskA & (board.occupiedSquares[1] | enPassantPos);
-            moves |= (position >> 9) & Utils::BitMaskB & (board.occupiedSquares[1] | enPassantPos);
+    if (board.pawnKey != computePawnKey()) {
+        std::cout << "info string pawn key mismatch: incremental " << board.pawnKey << ", recomputed " << computePawnKey() << std::endl;
+        std::abort();
+    }
 
-            // Double push if possible
-            if ((position & Utils::B_PawnStart) && ((position >> 8) & ~occupiedSquaresAll))
-                moves |= (position >> 16) & ~occupiedSquaresAll;
+    if (board.eval != computeEvalTerms()) {
+        std::cout << "info string eval terms mismatch: incremental mg " << board.eval.mg << ", recomputed " << computeEvalTerms().mg << std::endl;
+        std::abort();
+    }
+}
 
-            return moves;
-        }
 
+int Engine::evaluateBoard() const
+{
+    if (NNUE::network.loaded)
+        return NNUE::evaluate(board, accumulators, accumulatorIndex, isWhiteTurn);
 
-        case Pieces::Piece::W_KNIGHT:
-        case Pieces::Piece::B_KNIGHT: {
-            Bitboard moves = board.precomputedMoves.knightMoves[square];
-            return moves & ~board.occupiedSquares[Utils::isPieceWhite(piece)];
-        }
+    int mg = board.eval.mg;
+    int eg = board.eval.eg;
 
 
-        case Pieces::Piece::W_BISHOP:
-        case Pieces::Piece::B_BISHOP: {
-            int distLeft  = 7 - (square % 8);
-            int distRight = square % 8;
-            int distUp    = 7 - (square / 8);
-            int distDown  = square / 8;
+    // Pawn structure, from the pawn hash when possible
+    Pawns::Entry uncached;
+    Pawns::Entry& pawns = pawnTable ? (*pawnTable)[board.pawnKey] : uncached;
 
-            int shifts[4] = {9, -9, 7, -7};
+    if (!pawnTable || pawns.key != board.pawnKey)
+        Pawns::evaluate(board, pawns);
 
-            int maxLengths[4] = {
-                std::min(distLeft, distUp),    // Top left
-                std::min(distRight, distDown), // Bottom right
-                std::min(distRight, distUp),   // Top right
-                std::min(distLeft, distDown)   // Bottom left
-            };
+    mg += pawns.mg + Pawns::kingShield(board, pawns, true) - Pawns::kingShield(board, pawns, false);
+    eg += pawns.eg + Pawns::blockedPassers(board, pawns);
 
-            Bitboard moves = 0ULL;
 
-            for (int i = 0; i < 4; ++i) {
-                for (int j = 1; j <= maxLengths[i]; ++j) {
-                    Bitboard result = Utils::BitShift(position, shifts[i] * j);
-                    moves |= result;
+    // Promotions can push the phase past the starting position
+    const int phase = std::min(board.eval.phase, Eval::maxPhase);
+    const int score = (mg * phase + eg * (Eval::maxPhase - phase)) / Eval::maxPhase;
 
-                    if (result & occupiedSquaresAll)
-                        break;
-                }
-            }
+    // return score * (isWhiteTurn - !isWhiteTurn);
+    return score * (isWhiteTurn ? 1 : -1);
+}
 
-            return moves & ~board.occupiedSquares[Utils::isPieceWhite(piece)];
-        }
 
+Bitboard Engine::attackersTo(const Square square, const Bitboard occupied) const
+{
+    const BitboardArray& bb = board.bitboards;
+
+    const Bitboard rooksQueens   = bb[Pieces::Piece::W_ROOK] | bb[Pieces::Piece::B_ROOK] | bb[Pieces::Piece::W_QUEEN] | bb[Pieces::Piece::B_QUEEN];
+    const Bitboard bishopsQueens = bb[Pieces::Piece::W_BISHOP] | bb[Pieces::Piece::B_BISHOP] | bb[Pieces::Piece::W_QUEEN] | bb[Pieces::Piece::B_QUEEN];
+
+    // A pawn attacks square from where a pawn of the other color on square would capture
+    return (board.precomputedMoves.pawnAttacks[0][square] & bb[Pieces::Piece::W_PAWN]) |
+           (board.precomputedMoves.pawnAttacks[1][square] & bb[Pieces::Piece::B_PAWN]) |
+           (board.precomputedMoves.knightMoves[square] & (bb[Pieces::Piece::W_KNIGHT] | bb[Pieces::Piece::B_KNIGHT])) |
+           (board.precomputedMoves.kingMoves[square] & (bb[Pieces::Piece::W_KING] | bb[Pieces::Piece::B_KING])) |
+           (Attacks::rookAttacks(square, occupied) & rooksQueens) |
+           (Attacks::bishopAttacks(square, occupied) & bishopsQueens);
+}
 
-        case Pieces::Piece::W_ROOK:
-        case Pieces::Piece::B_ROOK: {
-            int shifts[4] = {1, -1, 8, -8};
 
-            int maxLengths[4] = {
-                7 - (square % 8),
-                square % 8,
-                7 - (square / 8),
-                square / 8
-            };
+Bitboard Engine::pinnedPieces(const Square kingSquare) const
+{
+    const Bitboard own      = board.occupiedSquares[isWhiteTurn];
+    const Bitboard occupied = board.occupiedSquares[0] | board.occupiedSquares[1];
 
-            Bitboard moves = 0ULL;
+    const Bitboard enemyQueens = board.bitboards[enemyPiece.QUEEN];
 
-            for (int i = 0; i < 4; ++i) {
-                for (int j = 1; j <= maxLengths[i]; ++j) {
-                    Bitboard result = Utils::BitShift(position, shifts[i] * j);
-                    moves |= result;
+    // Enemy sliders that would see the king through at most one piece
+    Bitboard snipers = (Attacks::rookAttacks(kingSquare, 0ULL) & (board.bitboards[enemyPiece.ROOK] | enemyQueens)) |
+                       (Attacks::bishopAttacks(kingSquare, 0ULL) & (board.bitboards[enemyPiece.BISHOP] | enemyQueens));
 
-                    if (result & occupiedSquaresAll)
-                        break;
-                }
-            }
+    Bitboard pinned = 0ULL;
 
-            return moves & ~board.occupiedSquares[Utils::isPieceWhite(piece)];
-        }
+    while (snipers) {
+        const int sniper = std::countr_zero(snipers);
+        snipers &= snipers - 1;
 
+        const Bitboard blockers = Attacks::between[kingSquare][sniper] & occupied;
 
-        case Pieces::Piece::W_QUEEN:
-        case Pieces::Piece::B_QUEEN: {
-            int distLeft  = 7 - (square % 8);
-            int distRight = square % 8;
-            int distUp    = 7 - (square / 8);
-            int distDown  = square / 8;
-
-            int shifts[8] = {1, -1, 8, -8, 9, -9, 7, -7};
-
-            int maxLengths[8] = {
-                distLeft,
-                distRight,
-                distUp,
-                distDown,
-                std::min(distLeft, distUp),    // Top left
-                std::min(distRight, distDown), // Bottom right
-                std::min(distRight, distUp),   // Top right
-                std::min(distLeft, distDown)   // Bottom left
-            };
-
-            Bitboard moves = 0ULL;
-
-            for (int i = 0; i < 8; ++i) {
-                for (int j = 1; j <= maxLengths[i]; ++j) {
-                    Bitboard result = Utils::BitShift(position, shifts[i] * j);
-                    moves |= result;
-
-                    if (result & occupiedSquaresAll)
-                        break;
-                }
-            }
+        if (std::has_single_bit(blockers))
+            pinned |= blockers & own;
+    }
 
-            return moves & ~board.occupiedSquares[Utils::isPieceWhite(piece)];
+    return pinned;
+}
+
+
+void Engine::generateLegalMoves(MoveList& moveList, const GenType type, const Bitboard fromMask) const
+{
+    const bool isWhite      = isWhiteTurn;
+    const Bitboard own      = board.occupiedSquares[isWhite];
+    const Bitboard enemy    = board.occupiedSquares[!isWhite];
+    const Bitboard occupied = own | enemy;
+
+    const Bitboard kingPos    = board.bitboards[ownPiece.KING];
+    const Square kingSquare   = std::countr_zero(kingPos);
+    const Bitboard checkers   = attackersTo(kingSquare, occupied) & enemy;
+    const Bitboard pinned     = pinnedPieces(kingSquare);
+
+    // Squares a non-pawn move may land on for this generation type
+    const Bitboard targetMask = (type == GenType::CAPTURES) ? enemy
+                              : (type == GenType::QUIETS)   ? ~occupied
+                                                            : ~own;
+
+    const auto addMoves = [&](const Square fromSquare, Bitboard targets) {
+        while (targets) {
+            const int toSquare = std::countr_zero(targets);
+            targets &= targets - 1;
+
+            moveList.moves[moveList.used++] = Pieces::Move(fromSquare, toSquare);
         }
+    };
 
 
-        case Pieces::Piece::W_KING: {
-            Bitboard moves = board.precomputedMoves.kingMoves[square];
+    // King, lifted off the board so it can't step back along a checking ray
+    Bitboard kingTargets = (kingPos & fromMask) ? (board.precomputedMoves.kingMoves[kingSquare] & targetMask) : 0ULL;
 
-            if ((board.castlingFlags & Utils::CastlingRightsFlags::W_KINGSIDE) &&
-                board.mailbox[square + 1] == Pieces::Piece::NONE &&
-                board.mailbox[square + 2] == Pieces::Piece::NONE) {
-                moves |= (position << 2);
-            }
-            if ((board.castlingFlags & Utils::CastlingRightsFlags::W_QUEENSIDE) &&
-                board.mailbox[square - 1] == Pieces::Piece::NONE &&
-                board.mailbox[square - 2] == Pieces::Piece::NONE &&
-                board.mailbox[square - 3] == Pieces::Piece::NONE) {
-                moves |= (position >> 2);
-            }
+    while (kingTargets) {
+        const int toSquare = std::countr_zero(kingTargets);
+        kingTargets &= kingTargets - 1;
 
-            return moves & ~board.occupiedSquares[1];
-        }
-        case Pieces::Piece::B_KING: {
-            Bitboard moves = board.precomputedMoves.kingMoves[square];
+        if (!(attackersTo(toSquare, occupied ^ kingPos) & enemy))
+            moveList.moves[moveList.used++] = Pieces::Move(kingSquare, toSquare);
+    }
 
-            if ((board.castlingFlags & Utils::CastlingRightsFlags::B_KINGSIDE) &&
-                board.mailbox[square + 1] == Pieces::Piece::NONE &&
-                board.mailbox[square + 2] == Pieces::Piece::NONE) {
-                moves |= (position << 2);
-            }
-            if ((board.castlingFlags & Utils::CastlingRightsFlags::B_QUEENSIDE) &&
-                board.mailbox[square - 1] == Pieces::Piece::NONE &&
-                board.mailbox[square - 2] == Pieces::Piece::NONE &&
-                board.mailbox[square - 3] == Pieces::Piece::NONE) {
-                moves |= (position >> 2);
-            }
+    // Double check, only the king can move
+    if (checkers & (checkers - 1))
+        return;
 
-            return moves & ~board.occupiedSquares[0];
-        }
+
+    // In check: capture the checker or block it
+    const Bitboard checkMask = checkers ? (Attacks::between[kingSquare][std::countr_zero(checkers)] | checkers) : ~0ULL;
+
+    const auto pinMask = [&](const Square square) {
+        return (pinned & (1ULL << square)) ? Attacks::line[kingSquare][square] : ~0ULL;
+    };
+
+
+    // Knights, a pinned knight can never move
+    Bitboard knights = board.bitboards[ownPiece.KNIGHT] & ~pinned & fromMask;
+
+    while (knights) {
+        const Square square = s_cast(Square, std::countr_zero(knights));
+        knights &= knights - 1;
+
+        addMoves(square, board.precomputedMoves.knightMoves[square] & targetMask & checkMask);
     }
 
-    return 0ULL;
-}
 
+    // Sliders
+    Bitboard diagonal = (board.bitboards[ownPiece.BISHOP] | board.bitboards[ownPiece.QUEEN]) & fromMask;
 
-Engine::MoveList Engine::generateAllMoves() const
-{
-    MoveList botMoves;
+    while (diagonal) {
+        const Square square = s_cast(Square, std::countr_zero(diagonal));
+        diagonal &= diagonal - 1;
 
+        addMoves(square, Attacks::bishopAttacks(square, occupied) & targetMask & checkMask & pinMask(square));
+    }
 
-    Pieces::ScoredMove scoredMoves[256] = {};
-    int usedScoredMoves                 = 0;
+    Bitboard straight = (board.bitboards[ownPiece.ROOK] | board.bitboards[ownPiece.QUEEN]) & fromMask;
 
+    while (straight) {
+        const Square square = s_cast(Square, std::countr_zero(straight));
+        straight &= straight - 1;
 
-    for (int square = 0; square < 64; ++square) {
-        const int& piece = board.mailbox[square];
+        addMoves(square, Attacks::rookAttacks(square, occupied) & targetMask & checkMask & pinMask(square));
+    }
 
-        if ((piece == Pieces::Piece::NONE) || (isWhiteTurn != Utils::isPieceWhite(piece)))
-            continue;
 
-        Bitboard movesBitboard = generatePieceMoves(square, piece);
-
-        // Loop over piece moves (loop over the bits)
-        while (movesBitboard) {
-            const int offset = std::countr_zero(movesBitboard);
-            movesBitboard &= ~(1ULL << offset);
-
-            if (((piece == Pieces::Piece::W_PAWN) && ((1ULL << square) & Utils::B_PawnStart)) ||
-                ((piece == Pieces::Piece::B_PAWN) && ((1ULL << square) & Utils::W_PawnStart))) [[unlikely]] {
-
-                scoredMoves[usedScoredMoves] = Pieces::ScoredMove{
-                    .move  = {s_cast(uint8_t, square), s_cast(uint8_t, offset), Pieces::PieceType::KNIGHT},
-                    .score = 8 * piece - board.mailbox[offset]
-                };
-                scoredMoves[usedScoredMoves + 1] = Pieces::ScoredMove{
-                    .move  = {s_cast(uint8_t, square), s_cast(uint8_t, offset), Pieces::PieceType::BISHOP},
-                    .score = 8 * piece - board.mailbox[offset]
-                };
-                scoredMoves[usedScoredMoves + 2] = Pieces::ScoredMove{
-                    .move  = {s_cast(uint8_t, square), s_cast(uint8_t, offset), Pieces::PieceType::ROOK},
-                    .score = 8 * piece - board.mailbox[offset]
-                };
-                scoredMoves[usedScoredMoves + 3] = Pieces::ScoredMove{
-                    .move  = {s_cast(uint8_t, square), s_cast(uint8_t, offset), Pieces::PieceType::QUEEN},
-                    .score = 8 * piece - board.mailbox[offset]
-                };
-
-                usedScoredMoves += 4;
+    // Pawns
+    const int forward            = isWhite ? 8 : -8;
+    const Bitboard startRank     = isWhite ? Utils::W_PawnStart : Utils::B_PawnStart;
+    const Bitboard promotionRank = isWhite ? 0xff00000000000000ULL : 0xffULL;
+    const Bitboard enPassantPos  = (board.enPassantSquare == 64) ? 0ULL : (1ULL << board.enPassantSquare);
+
+    Bitboard pawns = board.bitboards[ownPiece.PAWN] & fromMask;
+
+    // Promotions count as captures, they change the material balance
+    const Bitboard pawnMask = (type == GenType::CAPTURES) ? (enemy | promotionRank)
+                            : (type == GenType::QUIETS)   ? ~(enemy | promotionRank)
+                                                          : ~0ULL;
+
+    while (pawns) {
+        const Square square = s_cast(Square, std::countr_zero(pawns));
+        pawns &= pawns - 1;
+
+        Bitboard targets = board.precomputedMoves.pawnAttacks[isWhite][square] & enemy;
+
+        const Bitboard singlePush = (1ULL << (square + forward)) & ~occupied;
+        targets |= singlePush;
+
+        // Double push if possible
+        if (singlePush && ((1ULL << square) & startRank))
+            targets |= (1ULL << (square + 2 * forward)) & ~occupied;
+
+        targets &= checkMask & pinMask(square) & pawnMask;
+
+        while (targets) {
+            const uint8_t toSquare = s_cast(uint8_t, std::countr_zero(targets));
+            targets &= targets - 1;
+
+            if ((1ULL << toSquare) & promotionRank) [[unlikely]] {
+                moveList.moves[moveList.used++] = Pieces::Move(square, toSquare, Pieces::MoveFlag::PROMOTION_QUEEN);
+                moveList.moves[moveList.used++] = Pieces::Move(square, toSquare, Pieces::MoveFlag::PROMOTION_ROOK);
+                moveList.moves[moveList.used++] = Pieces::Move(square, toSquare, Pieces::MoveFlag::PROMOTION_BISHOP);
+                moveList.moves[moveList.used++] = Pieces::Move(square, toSquare, Pieces::MoveFlag::PROMOTION_KNIGHT);
             }
             else [[likely]] {
-                scoredMoves[usedScoredMoves++] = Pieces::ScoredMove{
-                    .move  = {s_cast(uint8_t, square), s_cast(uint8_t, offset), Pieces::PieceType::PIECE_TYPE_COUNT},
-                    .score = 8 * piece - board.mailbox[offset]
-                };
+                const bool isDoublePush = (toSquare == square + 2 * forward);
+                moveList.moves[moveList.used++] = Pieces::Move(square, toSquare, isDoublePush ? Pieces::MoveFlag::DOUBLE_PUSH : Pieces::MoveFlag::NONE);
             }
         }
+
+        // En passant, checked by looking at the board after the capture since two pieces leave the rank
+        if ((type != GenType::QUIETS) && (board.precomputedMoves.pawnAttacks[isWhite][square] & enPassantPos)) [[unlikely]] {
+            const Bitboard capturedPos = isWhite ? (enPassantPos >> 8) : (enPassantPos << 8);
+            const Bitboard after       = (occupied ^ (1ULL << square) ^ capturedPos) | enPassantPos;
+
+            if (!(attackersTo(kingSquare, after) & enemy & ~capturedPos))
+                moveList.moves[moveList.used++] = Pieces::Move(square, board.enPassantSquare, Pieces::MoveFlag::EN_PASSANT);
+        }
+    }
+
+
+    // Castling, never out of or through check
+    if (!checkers && (type != GenType::CAPTURES) && (kingPos & fromMask)) {
+        const char kingsideFlag  = isWhite ? Utils::CastlingRightsFlags::W_KINGSIDE : Utils::CastlingRightsFlags::B_KINGSIDE;
+        const char queensideFlag = isWhite ? Utils::CastlingRightsFlags::W_QUEENSIDE : Utils::CastlingRightsFlags::B_QUEENSIDE;
+
+        const auto isSafe = [&](const int square) {
+            return !(attackersTo(square, occupied) & enemy);
+        };
+
+        if ((board.castlingFlags & kingsideFlag) &&
+            !(occupied & ((1ULL << (kingSquare + 1)) | (1ULL << (kingSquare + 2)))) &&
+            isSafe(kingSquare + 1) && isSafe(kingSquare + 2)) {
+            moveList.moves[moveList.used++] = Pieces::Move(kingSquare, kingSquare + 2, Pieces::MoveFlag::CASTLING);
+        }
+
+        if ((board.castlingFlags & queensideFlag) &&
+            !(occupied & ((1ULL << (kingSquare - 1)) | (1ULL << (kingSquare - 2)) | (1ULL << (kingSquare - 3)))) &&
+            isSafe(kingSquare - 1) && isSafe(kingSquare - 2)) {
+            moveList.moves[moveList.used++] = Pieces::Move(kingSquare, kingSquare - 2, Pieces::MoveFlag::CASTLING);
+        }
     }
+}
 
-    std::sort(scoredMoves, scoredMoves + usedScoredMoves + 1, [](const Pieces::ScoredMove& a, const Pieces::ScoredMove& b) {
-        return a.score > b.score;
-    });
 
-    for (int i = 0; i < usedScoredMoves; ++i) {
-        botMoves.moves[botMoves.used++] = scoredMoves[i].move;
+Engine::MoveList Engine::generateAllMoves() const
+{
+    MoveList moves;
+    generateLegalMoves(moves);
+
+    return moves;
+}
+
+
+bool Engine::isLegalMove(const Pieces::Move& move, const GenType type) const
+{
+    if (move.isNull())
+        return false;
+
+    // Only the moves of the piece on the from square need generating
+    MoveList moves;
+    generateLegalMoves(moves, type, 1ULL << move.from());
+
+    for (int i = 0; i < moves.used; ++i) {
+        if (moves.moves[i] == move)
+            return true;
     }
 
-    return botMoves;
+    return false;
 }
 
 
 void Engine::makeMove(const Pieces::Move& move)
 {
-    // Store history
-    board.history.history[board.history.used++] = Board::HistoryState(board);
+    const int piece    = board.mailbox[move.from()];
+    const bool isWhite = Utils::isPieceWhite(piece);
+
+    const bool isEnPassant = move.isEnPassant();
+
+    const Square capturedSquare = isEnPassant ? (isWhite ? move.to() - 8 : move.to() + 8) : move.to();
+    const int capturedPiece     = board.mailbox[capturedSquare];
+
+
+    // Store irreversible state
+    board.history.history[board.history.used++] = Board::HistoryState{
+        .move            = move,
+        .capturedPiece   = capturedPiece,
+        .enPassantSquare = board.enPassantSquare,
+        .castlingFlags   = board.castlingFlags,
+        .halfmoveClock   = board.halfmoveClock
+    };
 
     ++board.plyCount;
 
-    const int piece    = board.mailbox[move.fromSquare];
-    const bool isWhite = Utils::isPieceWhite(piece);
+    // Captures and pawn moves can't be undone, the 50-move count starts again
+    if (capturedPiece != Pieces::Piece::NONE || piece == ownPiece.PAWN)
+        board.halfmoveClock = 0;
+    else
+        ++board.halfmoveClock;
+
+    NNUE::DirtyPieces& dirty = pushAccumulator();
+
 
-    const Bitboard fromPos = 1ULL << move.fromSquare;
-    const Bitboard toPos   = 1ULL << move.toSquare;
+    // Take the old castling rights and en passant square out of the key
+    board.key ^= Zobrist::castling(board.castlingFlags) ^ Zobrist::enPassant(board.enPassantSquare);
 
 
     // Remove castling rights
     if (piece == ownPiece.KING) {
-        if (Utils::isPieceWhite(ownPiece.KING)) {
+        if (isWhite) {
             board.castlingFlags &= ~Utils::CastlingRightsFlags::W_KINGSIDE;
             board.castlingFlags &= ~Utils::CastlingRightsFlags::W_QUEENSIDE;
         }
@@ -437,81 +544,54 @@ void Engine::makeMove(const Pieces::Move& move)
         }
     }
     else {
-        switch (move.fromSquare) {
-            case 0:  board.castlingFlags &= ~Utils::CastlingRightsFlags::W_QUEENSIDE; break;
-            case 7:  board.castlingFlags &= ~Utils::CastlingRightsFlags::W_KINGSIDE; break;
-            case 56: board.castlingFlags &= ~Utils::CastlingRightsFlags::B_QUEENSIDE; break;
-            case 63: board.castlingFlags &= ~Utils::CastlingRightsFlags::B_KINGSIDE; break;
-        }
-        switch (move.toSquare) {
+        switch (move.from()) {
             case 0:  board.castlingFlags &= ~Utils::CastlingRightsFlags::W_QUEENSIDE; break;
             case 7:  board.castlingFlags &= ~Utils::CastlingRightsFlags::W_KINGSIDE; break;
             case 56: board.castlingFlags &= ~Utils::CastlingRightsFlags::B_QUEENSIDE; break;
             case 63: board.castlingFlags &= ~Utils::CastlingRightsFlags::B_KINGSIDE; break;
         }
     }
+    switch (move.to()) {
+        case 0:  board.castlingFlags &= ~Utils::CastlingRightsFlags::W_QUEENSIDE; break;
+        case 7:  board.castlingFlags &= ~Utils::CastlingRightsFlags::W_KINGSIDE; break;
+        case 56: board.castlingFlags &= ~Utils::CastlingRightsFlags::B_QUEENSIDE; break;
+        case 63: board.castlingFlags &= ~Utils::CastlingRightsFlags::B_KINGSIDE; break;
+    }
 
 
     // Handle castling
-    if ((piece >> 1 == Pieces::PieceType::KING) && (move.fromSquare + 2 == move.toSquare)) {
-        // Kingside castle
-        board.bitboards[ownPiece.ROOK] &= ~(toPos << 1);
-        board.bitboards[ownPiece.ROOK] |= (toPos >> 1);
-
-        board.mailbox[move.toSquare + 1] = Pieces::Piece::NONE;
-        board.mailbox[move.toSquare - 1] = ownPiece.ROOK;
+    if (move.isCastle()) [[unlikely]] {
+        const bool isKingside = move.from() + 2 == move.to();
+        const Square rookFrom = isKingside ? move.to() + 1 : move.to() - 2;
+        const Square rookTo   = isKingside ? move.to() - 1 : move.to() + 1;
 
-        board.occupiedSquares[isWhite] &= ~(toPos << 1);
-        board.occupiedSquares[isWhite] |= (toPos >> 1);
-    }
-    else if ((piece >> 1 == Pieces::PieceType::KING) && (move.fromSquare - 2 == move.toSquare)) {
-        // Queenside castle
-        board.bitboards[ownPiece.ROOK] &= ~(toPos >> 1);
-        board.bitboards[ownPiece.ROOK] |= (toPos << 1);
-
-        board.mailbox[move.toSquare - 2] = Pieces::Piece::NONE;
-        board.mailbox[move.toSquare + 1] = ownPiece.ROOK;
-
-        board.occupiedSquares[isWhite] &= ~(toPos >> 2);
-        board.occupiedSquares[isWhite] |= (toPos << 1);
+        board.movePiece(rookFrom, rookTo);
+        dirty.add(ownPiece.ROOK, rookFrom, rookTo);
     }
 
 
     // Handle captures (if any)
-    int capturedPiece = board.mailbox[move.toSquare];
     if (capturedPiece != Pieces::Piece::NONE) {
-        // Normal capture
-        board.bitboards[capturedPiece] &= ~toPos;
-        board.occupiedSquares[Utils::isPieceWhite(capturedPiece)] &= ~toPos;
-    }
-    else if ((move.toSquare == board.enPassantSquare) && (piece >> 1) == Pieces::PieceType::PAWN) {
-        // En passant capture
-        if (isWhite) {
-            board.bitboards[enemyPiece.PAWN] &= ~(toPos >> 8);
-            board.occupiedSquares[0] &= ~(toPos >> 8);
-            board.mailbox[move.toSquare - 8] = Pieces::Piece::NONE;
-        }
-        else {
-            board.bitboards[enemyPiece.PAWN] &= ~(toPos << 8);
-            board.occupiedSquares[1] &= ~(toPos << 8);
-            board.mailbox[move.toSquare + 8] = Pieces::Piece::NONE;
-        }
+        board.removePiece(capturedSquare);
+        dirty.add(capturedPiece, capturedSquare, 64);
     }
 
 
     // Update positions
-    board.bitboards[piece] &= ~fromPos;
-    board.mailbox[move.fromSquare] = Pieces::Piece::NONE;
-
-    const int newPiece = (move.promotionPieceType == Pieces::PieceType::PIECE_TYPE_COUNT) ? piece : (move.promotionPieceType << 1) | (!isWhite);
+    board.movePiece(move.from(), move.to());
 
-    board.bitboards[newPiece] |= toPos;
-    board.mailbox[move.toSquare] = newPiece;
+    if (move.isPromotion()) [[unlikely]] {
+        const int promotedPiece = (move.promotionPieceType() << 1) | (!isWhite);
 
+        board.removePiece(move.to());
+        board.putPiece(promotedPiece, move.to());
 
-    // Update occupied squares
-    board.occupiedSquares[isWhite] &= ~fromPos;
-    board.occupiedSquares[isWhite] |= toPos;
+        dirty.add(piece, move.from(), 64);
+        dirty.add(promotedPiece, 64, move.to());
+    }
+    else {
+        dirty.add(piece, move.from(), move.to());
+    }
 
 
     flipColor();
@@ -522,212 +602,467 @@ void Engine::makeMove(const Pieces::Move& move)
 
 
     // Set en passant square for next turn
-    if ((board.mailbox[move.toSquare] == Pieces::Piece::W_PAWN) && (move.fromSquare + 16 == move.toSquare)) [[unlikely]] {
-        board.enPassantSquare = move.fromSquare + 8;
-    }
-    else if ((board.mailbox[move.toSquare] == Pieces::Piece::B_PAWN) && (move.fromSquare - 16 == move.toSquare)) [[unlikely]] {
-        board.enPassantSquare = move.fromSquare - 8;
-    }
+    if (move.isDoublePush()) [[unlikely]]
+        board.enPassantSquare = (move.from() + move.to()) / 2;
+
+
+    board.key ^= Zobrist::castling(board.castlingFlags) ^ Zobrist::enPassant(board.enPassantSquare) ^ Zobrist::keys.blackToMove;
+
+    if (debugMode) [[unlikely]]
+        verifyKey();
 }
 
 
 void Engine::makeUCIMove(const std::string& UCI_Move)
 {
-    Pieces::Move move = Utils::moveFromUCI(UCI_Move);
-    makeMove(move);
+    // The UCI string has no flags, take them from the matching legal move
+    const Pieces::Move uciMove = Utils::moveFromUCI(UCI_Move);
+
+    MoveList moves;
+    generateLegalMoves(moves, GenType::ALL, 1ULL << uciMove.from());
+
+    for (int i = 0; i < moves.used; ++i) {
+        if (moves.moves[i].from() == uciMove.from() && moves.moves[i].to() == uciMove.to() &&
+            moves.moves[i].promotionPieceType() == uciMove.promotionPieceType()) {
+            makeMove(moves.moves[i]);
+
+            // Game moves are never undone by the search, keep the accumulator stack from growing
+            accumulators[0]  = accumulators[accumulatorIndex];
+            accumulatorIndex = 0;
+            return;
+        }
+    }
 }
 
 
 void Engine::undoMove()
 {
     const Board::HistoryState& state = board.history.history[--board.history.used];
+    const Pieces::Move& move         = state.move;
 
     flipColor();
 
-    board.bitboards          = state.bitboards;
-    board.mailbox            = state.mailbox;
-    board.enPassantSquare    = state.enPassantSquare;
-    board.castlingFlags      = state.castlingFlags;
-    board.occupiedSquares[0] = state.occupiedSquares[0];
-    board.occupiedSquares[1] = state.occupiedSquares[1];
+    board.key ^= Zobrist::castling(board.castlingFlags) ^ Zobrist::enPassant(board.enPassantSquare) ^ Zobrist::keys.blackToMove;
+
+    board.enPassantSquare = state.enPassantSquare;
+    board.castlingFlags   = state.castlingFlags;
+    board.halfmoveClock   = state.halfmoveClock;
+
+    board.key ^= Zobrist::castling(board.castlingFlags) ^ Zobrist::enPassant(board.enPassantSquare);
+
+
+    // Move the piece back, demoting it if needed
+    if (move.isPromotion()) [[unlikely]] {
+        board.removePiece(move.to());
+        board.putPiece(ownPiece.PAWN, move.from());
+    }
+    else {
+        board.movePiece(move.to(), move.from());
+    }
+
+    // Put back captured piece
+    if (state.capturedPiece != Pieces::Piece::NONE) {
+        if (move.isEnPassant())
+            board.putPiece(state.capturedPiece, isWhiteTurn ? move.to() - 8 : move.to() + 8);
+        else
+            board.putPiece(state.capturedPiece, move.to());
+    }
+
+
+    // Put back castled rook
+    if (move.isCastle()) [[unlikely]] {
+        if (move.from() + 2 == move.to())
+            board.movePiece(move.to() - 1, move.to() + 1); // Kingside castle
+        else
+            board.movePiece(move.to() + 1, move.to() - 2); // Queenside castle
+    }
 
     --board.plyCount;
+
+    popAccumulator();
+
+    if (debugMode) [[unlikely]]
+        verifyKey();
 }
 
 
-bool Engine::isAttacked(const Square square)
+void Engine::makeNullMove()
 {
-    const Bitboard occupiedSquaresAll = (board.occupiedSquares[0] | board.occupiedSquares[1]);
+    board.history.history[board.history.used++] = Board::HistoryState{
+        .move            = Pieces::Move{},
+        .capturedPiece   = Pieces::Piece::NONE,
+        .enPassantSquare = board.enPassantSquare,
+        .castlingFlags   = board.castlingFlags,
+        .halfmoveClock   = board.halfmoveClock
+    };
 
-    const Bitboard position = (1ULL << square);
+    ++board.plyCount;
+    ++board.halfmoveClock;
 
+    pushAccumulator(); // Nothing changes, the accumulator is copied
 
-    // General
-    int distLeft  = 7 - (square % 8);
-    int distRight = square % 8;
-    int distUp    = 7 - (square / 8);
-    int distDown  = square / 8;
+    board.key ^= Zobrist::enPassant(board.enPassantSquare) ^ Zobrist::keys.blackToMove;
+    board.enPassantSquare = 64;
 
+    flipColor();
 
+    if (debugMode) [[unlikely]]
+        verifyKey();
+}
 
-    // Knight =============================================================
-    Bitboard knightMoves = board.precomputedMoves.knightMoves[square];
-    // ====================================================================
 
+void Engine::undoNullMove()
+{
+    const Board::HistoryState& state = board.history.history[--board.history.used];
 
+    flipColor();
 
-    // Queen ==============================================================
-    int shiftsQueen[8]     = {1, -1, 8, -8, 9, -9, 7, -7};
-    int maxLengthsQueen[8] = {
-        distLeft,
-        distRight,
-        distUp,
-        distDown,
-        std::min(distLeft, distUp),    // Top left
-        std::min(distRight, distDown), // Bottom right
-        std::min(distRight, distUp),   // Top right
-        std::min(distLeft, distDown)   // Bottom left
-    };
+    board.enPassantSquare = state.enPassantSquare;
+    board.halfmoveClock   = state.halfmoveClock;
+    board.key ^= Zobrist::enPassant(board.enPassantSquare) ^ Zobrist::keys.blackToMove;
 
-    Bitboard queenMoves = 0ULL;
-    for (int i = 0; i < 8; ++i) {
-        for (int j = 1; j <= maxLengthsQueen[i]; ++j) {
-            Bitboard result = Utils::BitShift(position, shiftsQueen[i] * j);
-            queenMoves |= result;
+    --board.plyCount;
 
-            if (result & occupiedSquaresAll)
-                break;
-        }
-    }
-    // ====================================================================
+    popAccumulator();
 
+    if (debugMode) [[unlikely]]
+        verifyKey();
+}
 
 
-    // Rook ===============================================================
-    int shiftsRook[4]     = {1, -1, 8, -8};
-    int maxLengthsRook[4] = {
-        7 - (square % 8),
-        square % 8,
-        7 - (square / 8),
-        square / 8
-    };
+NNUE::DirtyPieces& Engine::pushAccumulator()
+{
+    NNUE::Accumulator& accumulator = accumulators[++accumulatorIndex];
 
-    Bitboard rookMoves = 0ULL;
-    for (int i = 0; i < 4; ++i) {
-        for (int j = 1; j <= maxLengthsRook[i]; ++j) {
-            Bitboard result = Utils::BitShift(position, shiftsRook[i] * j);
-            rookMoves |= result;
+    accumulator.computed[0] = false;
+    accumulator.computed[1] = false;
+    accumulator.dirty.count = 0;
 
-            if (result & occupiedSquaresAll)
-                break;
-        }
+    return accumulator.dirty;
+}
+
+
+void Engine::popAccumulator()
+{
+    // Undoing a game move (debug "undo") goes below the stack, start over from the board
+    if (accumulatorIndex > 0)
+        --accumulatorIndex;
+    else
+        resetAccumulators();
+}
+
+
+void Engine::resetAccumulators()
+{
+    for (int i = 0; i <= accumulatorIndex; ++i) {
+        accumulators[i].computed[0] = false;
+        accumulators[i].computed[1] = false;
     }
-    // ====================================================================
+}
 
 
+bool Engine::hasNonPawnMaterial() const
+{
+    return board.bitboards[ownPiece.KNIGHT] | board.bitboards[ownPiece.BISHOP] |
+           board.bitboards[ownPiece.ROOK] | board.bitboards[ownPiece.QUEEN];
+}
 
-    // Bishop =============================================================
-    int shiftsBishop[4]     = {9, -9, 7, -7};
-    int maxLengthsBishop[4] = {
-        std::min(distLeft, distUp),    // Top left
-        std::min(distRight, distDown), // Bottom right
-        std::min(distRight, distUp),   // Top right
-        std::min(distLeft, distDown)   // Bottom left
-    };
 
-    Bitboard bishopMoves = 0ULL;
-    for (int i = 0; i < 4; ++i) {
-        for (int j = 1; j <= maxLengthsBishop[i]; ++j) {
-            Bitboard result = Utils::BitShift(position, shiftsBishop[i] * j);
-            bishopMoves |= result;
+int Engine::captureGain(const Pieces::Move& move) const
+{
+    const int captured = board.mailbox[move.to()];
+
+    int gain = 0;
+
+    if (captured != Pieces::Piece::NONE)
+        gain = Pieces::pieceValues[captured >> 1];
+
+    else if (move.isEnPassant())
+        gain = Pieces::pieceValues[Pieces::PieceType::PAWN];
+
+    if (move.isPromotion())
+        gain += Pieces::pieceValues[move.promotionPieceType()] - Pieces::pieceValues[Pieces::PieceType::PAWN];
+
+    return gain;
+}
+
+
+/*
+    Static exchange evaluation (swap algorithm)
+
+    Both sides keep recapturing on the target square with their least
+    valuable attacker. Attackers are recomputed from the occupancy left
+    after every capture, so sliders lined up behind the piece that just
+    captured (x-rays) join in. Either side may stop capturing when it is
+    ahead, which the backwards pass over gain[] accounts for. Pins are
+    ignored.
+*/
+
+int Engine::see(const Pieces::Move& move) const
+{
+    const Square toSquare = move.to();
+    const int piece       = board.mailbox[move.from()];
+
+    // Castling never exchanges anything
+    if (move.isCastle())
+        return 0;
+
+    Bitboard occupied = board.occupiedSquares[0] | board.occupiedSquares[1];
+
+    if (move.isEnPassant())
+        occupied ^= 1ULL << (Utils::isPieceWhite(piece) ? toSquare - 8 : toSquare + 8);
+
+    int gain[32];
+    int depth = 0;
+
+    gain[0] = captureGain(move);
+
+    // Piece standing on the target square, next in line to be captured
+    int victim = move.isPromotion() ? move.promotionPieceType() : (piece >> 1);
 
-            if (result & occupiedSquaresAll)
+    Bitboard fromSet = 1ULL << move.from();
+    bool side        = Utils::isPieceWhite(piece);
+
+    do {
+        ++depth;
+        // Speculative, only kept if the other side has a recapture
+        gain[depth] = Pieces::pieceValues[victim] - gain[depth - 1];
+
+        occupied ^= fromSet;
+        side = !side;
+
+        const Bitboard attackers = attackersTo(toSquare, occupied) & occupied;
+        const Bitboard own       = attackers & board.occupiedSquares[side];
+
+        fromSet = 0ULL;
+
+        for (int type = Pieces::PieceType::PAWN; type <= Pieces::PieceType::KING; ++type) {
+            const Bitboard candidates = own & board.bitboards[2 * type + !side];
+
+            if (candidates) {
+                fromSet = candidates & -candidates;
+                victim  = type;
                 break;
+            }
         }
-    }
-    // ====================================================================
 
+        // The king can't capture into a defended square
+        if (victim == Pieces::PieceType::KING && (attackers & board.occupiedSquares[!side]))
+            fromSet = 0ULL;
 
+    } while (fromSet && depth < 31);
 
-    // Pawn ===============================================================
-    Bitboard pawnMoves = 0ULL;
-    if (Utils::isPieceWhite(ownPiece.KING)) {
-        pawnMoves |= (position << 8) & ~occupiedSquaresAll;
-        pawnMoves |= (position << 7) & Utils::BitMaskB;
-        pawnMoves |= (position << 9) & Utils::BitMaskA;
-    }
-    else {
-        pawnMoves |= (position >> 8) & ~occupiedSquaresAll;
-        pawnMoves |= (position >> 7) & Utils::BitMaskA;
-        pawnMoves |= (position >> 9) & Utils::BitMaskB;
-    }
-    // ====================================================================
+    while (--depth)
+        gain[depth - 1] = -std::max(-gain[depth - 1], gain[depth]);
+
+    return gain[0];
+}
 
 
+bool Engine::isInCheck() const
+{
+    const Square kingSquare = std::countr_zero(board.bitboards[ownPiece.KING]);
+    const Bitboard occupied = board.occupiedSquares[0] | board.occupiedSquares[1];
 
-    // King ===============================================================
-    Bitboard kingMoves = board.precomputedMoves.kingMoves[square];
-    // ====================================================================
+    return attackersTo(kingSquare, occupied) & board.occupiedSquares[!isWhiteTurn];
+}
 
 
+Pieces::Move* Engine::counterMoveEntry() const
+{
+    if (board.history.used == 0)
+        return nullptr;
 
-    // clang-format off
-    if      (queenMoves  & board.bitboards[enemyPiece.QUEEN])  return true;
-    else if (rookMoves   & board.bitboards[enemyPiece.ROOK])   return true;
-    else if (bishopMoves & board.bitboards[enemyPiece.BISHOP]) return true;
-    else if (knightMoves & board.bitboards[enemyPiece.KNIGHT]) return true;
-    else if (pawnMoves   & board.bitboards[enemyPiece.PAWN])   return true;
-    else if (kingMoves   & board.bitboards[enemyPiece.KING])   return true;
+    const Pieces::Move& previous = board.history.history[board.history.used - 1].move;
 
-    return false;
-    // clang-format on
+    if (previous.isNull())
+        return nullptr;
+
+    return &heuristics->counterMoves[board.mailbox[previous.to()]][previous.to()];
 }
 
 
-bool Engine::isLegalCastle(const Pieces::Move& move)
+void Engine::flushNodes()
 {
-    // Castling legality
-    if ((board.mailbox[move.fromSquare] == ownPiece.KING) &&
-        ((move.toSquare == move.fromSquare + 2) || (move.toSquare == move.fromSquare - 2))) {
+    Search::totalNodes.fetch_add(nodes - flushedNodes, std::memory_order_relaxed);
+    flushedNodes = nodes;
+}
 
-        Square ownKingSquare = std::countr_zero(board.bitboards[ownPiece.KING]);
 
-        if (isAttacked(ownKingSquare) ||
-            ((move.fromSquare + 2 == move.toSquare) && (isAttacked(ownKingSquare + 1) || isAttacked(ownKingSquare + 2))) ||
-            ((move.fromSquare - 2 == move.toSquare) && (isAttacked(ownKingSquare - 1) || isAttacked(ownKingSquare - 2)))) {
-            return false;
-        }
-        else {
-            return true;
-        }
+void Engine::checkLimits()
+{
+    flushNodes();
+
+    if (Search::stopSignal.load(std::memory_order_relaxed))
+        stopped = true;
+
+    // Helpers run until the main thread raises the stop signal
+    if (threadId != 0)
+        return;
+
+    // Limits don't apply while pondering, the clock starts at ponderhit
+    if (isPondering) {
+        if (Search::ponder.load(std::memory_order_relaxed))
+            return;
+
+        isPondering = false;
+        timeStart   = Utils::now();
     }
 
-    // Not a castle move
-    return true;
+    if (limits.nodes && nodes >= limits.nodes)
+        stopped = true;
+
+    if (timeManager.isTimed && Utils::now() - timeStart >= timeManager.hardLimit)
+        stopped = true;
 }
 
 
-bool Engine::wasIllegalMove()
+void Engine::printInfo(const int depth, const int score)
 {
-    flipColor();
+    flushNodes();
 
-    bool isIllegalMove = isAttacked(std::countr_zero(board.bitboards[ownPiece.KING]));
+    const int64_t elapsed = Utils::now() - startTime;
+    const uint64_t total  = Search::totalNodes.load(std::memory_order_relaxed);
 
-    flipColor();
+    // Built up front and written at once, the UCI thread may print at the same time
+    std::string info = "info depth " + std::to_string(depth) +
+                       " score " + Search::scoreToUCI(score) +
+                       " nodes " + std::to_string(total) +
+                       " nps " + std::to_string(total * 1000 / s_cast(uint64_t, std::max<int64_t>(elapsed, 1))) +
+                       " time " + std::to_string(elapsed) +
+                       " hashfull " + std::to_string(TT::table.hashfull());
+
+    if (Syzygy::cardinality)
+        info += " tbhits " + std::to_string(Search::tbHits.load(std::memory_order_relaxed));
+
+    info += " pv";
+
+    for (int i = 0; i < pv.length[0]; ++i)
+        info += " " + Utils::toUCI(pv.moves[0][i]);
 
-    return isIllegalMove;
+    std::cout << info + "\n" << std::flush;
 }
 
 
-std::string Engine::getEngineMove()
+void Engine::printOrderingStats() const
 {
-    bestMove = {};
+    // Share of quiet cutoffs found by each heuristic, history counts only the first quiet tried
+    const std::string info = "info string cutoffs " + std::to_string(heuristics->cutoffs) +
+                             " quiet " + std::to_string(heuristics->quietCutoffs) +
+                             " killer " + std::to_string(heuristics->hitRate(heuristics->killerHits)) + "%" +
+                             " countermove " + std::to_string(heuristics->hitRate(heuristics->counterHits)) + "%" +
+                             " history " + std::to_string(heuristics->hitRate(heuristics->historyHits)) + "%";
+
+    std::cout << info + "\n" << std::flush;
+}
+
+
+std::string Engine::getEngineMove(const Search::Limits& searchLimits)
+{
+    limits      = searchLimits;
+    bestMove    = {};
+    ponderMove  = {};
+    stopped      = false;
+    nodes        = 0;
+    flushedNodes = 0;
+    rootPly      = board.plyCount;
+    startTime    = Utils::now();
+    timeStart    = startTime;
+    isPondering  = Search::ponder.load();
+
+    timeManager.init(limits, isWhiteTurn);
+
+    heuristics->newSearch();
+
+    // A root in the tablebases only searches the moves keeping the best result, no need to probe below it
+    rootMoves.used = 0;
+    tbCardinality  = Syzygy::cardinality;
+
+    if (Syzygy::cardinality && !board.castlingFlags &&
+        std::popcount(board.occupiedSquares[0] | board.occupiedSquares[1]) <= Syzygy::cardinality &&
+        Syzygy::filterRootMoves(*this, rootMoves))
+        tbCardinality = 0;
 
     // randomMove();
-    // negaMax(Settings::maxPlyDepth);
-    alphaBeta(Settings::maxPlyDepth, -std::numeric_limits<int>::max(), std::numeric_limits<int>::max());
+    // negaMax(Settings::defaultDepth);
+
+    // Iterative deepening, odd helpers start one ply deeper so threads spread over depths
+    int score = 0;
+
+    for (int depth = 1 + (threadId & 1); depth <= limits.depth; ++depth) {
+        // Aspiration window around the last score, widened on every fail
+        int delta = Settings::aspirationWindow;
+        int alpha = -Settings::infinity;
+        int beta  = Settings::infinity;
+
+        if (Search::options.aspiration && depth >= 4) {
+            alpha = std::max(score - delta, -Settings::infinity);
+            beta  = std::min(score + delta, Settings::infinity);
+        }
+
+        while (true) {
+            score = alphaBeta(depth, alpha, beta);
+
+            if (stopped)
+                break;
+
+            if (score <= alpha)
+                alpha = std::max(score - delta, -Settings::infinity);
+            else if (score >= beta)
+                beta = std::min(score + delta, Settings::infinity);
+            else
+                break;
+
+            delta *= 2;
+        }
+
+        // An interrupted iteration is only used if there is nothing better
+        if (stopped && depth > 1)
+            break;
+
+        const Pieces::Move previousBestMove = bestMove;
+
+        if (pv.length[0] > 0)
+            bestMove = pv.moves[0][0];
+
+        ponderMove = (pv.length[0] > 1) ? pv.moves[0][1] : Pieces::Move{};
+
+        if (stopped)
+            break;
+
+        if (threadId != 0)
+            continue;
+
+        printInfo(depth, score);
+
+        const bool bestMoveChanged = (bestMove != previousBestMove);
+
+        if (timeManager.shouldStop(Utils::now() - timeStart, depth, score, bestMoveChanged) && !Search::ponder)
+            break;
+    }
+
+    flushNodes();
+
+    if (threadId != 0)
+        return "";
+
+    printOrderingStats();
+
+    // "go infinite" and "go ponder" must not answer before "stop" or "ponderhit"
+    while ((limits.infinite || Search::ponder) && !Search::stopSignal)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    // Stopped before a single root move finished
+    if (bestMove.isNull()) {
+        const MoveList moves = rootMoves.used ? rootMoves : generateAllMoves();
+
+        if (moves.used > 0)
+            bestMove = moves.moves[0];
+    }
 
-    makeMove(bestMove);
+    // Null move if there are no legal moves
+    if (bestMove.isNull())
+        return "0000";
 
     return Utils::toUCI(bestMove);
 }
@@ -4,9 +4,17 @@
 #include <vector>
 #include <limits>
 #include <bit>
+#include <thread>
+#include <algorithm>
 
 #include "settings.hpp"
+#include "search.hpp"
+#include "timeman.hpp"
 #include "board.hpp"
+#include "attacks.hpp"
+#include "transposition.hpp"
+#include "pawns.hpp"
+#include "nnue.hpp"
 #include "utils.hpp"
 #include "pieces.hpp"
 
@@ -15,7 +23,7 @@ struct Engine
 {
     struct MoveList
     {
-        Pieces::Move moves[256] = {};
+        Pieces::Move moves[256];
 
         int used = 0ULL;
     };
@@ -44,31 +52,118 @@ struct Engine
 
     Pieces::Move bestMove = {};
 
+    // Search state
+    Search::Limits limits = {};
+    Search::PVTable pv    = {};
+    TimeManager timeManager;
+
+    Pieces::Move ponderMove = {};
+
+    // Lazy SMP: thread 0 owns the clock and output, helpers only fill the shared TT
+    int threadId = 0;
+
+    // Owned by the search thread running this engine
+    Search::Heuristics* heuristics = nullptr; // Quiet move ordering
+    Pawns::Table* pawnTable        = nullptr; // Null outside a search, pawns are evaluated uncached
+
+    uint64_t nodes        = 0;
+    uint64_t flushedNodes = 0; // Already added to Search::totalNodes
+    int rootPly           = 0;
+    int64_t startTime     = 0; // Search start, for info output
+    int64_t timeStart     = 0; // Time limits count from here, moved to ponderhit when pondering
+    bool isPondering      = false;
+    bool stopped          = false;
+
+    // Root moves kept by the tablebases, none if the root isn't in them
+    MoveList rootMoves = {};
+    int tbCardinality  = 0; // Probe nodes with at most this many pieces, 0 once the root is solved
+
     void loadFEN(const std::vector<std::string>& FEN);
 
+    // NNUE accumulators, one per ply from the last position set up by the GUI, filled lazily by evaluateBoard().
+    // Tablebase probes play a few captures past the deepest search ply
+    mutable NNUE::Accumulator accumulators[Settings::maxPly + 16];
+    int accumulatorIndex = 0;
+
+    NNUE::DirtyPieces& pushAccumulator();
+    void popAccumulator();
+
+    // Forget the computed accumulators, after a new position or network
+    void resetAccumulators();
+
+    // Debug mode (UCI "debug on") checks the incremental key and eval terms after every make/undo
+    bool debugMode = false;
+
+    uint64_t computeKey() const;
+    uint64_t computePawnKey() const;
+    Eval::Terms computeEvalTerms() const;
+    void verifyKey() const;
+
     // Engine functions
     int evaluateBoard() const;
     int quiescentSearch(int alpha, const int beta);
 
-    Bitboard generatePieceMoves(const Square& square, const int& piece) const;
+    Bitboard attackersTo(const Square square, const Bitboard occupied) const;
+    Bitboard pinnedPieces(const Square kingSquare) const;
+
+    // Captures include promotions, quiets are everything else
+    enum class GenType
+    {
+        ALL,
+        CAPTURES,
+        QUIETS
+    };
+
+    // Legal moves only, pins and checks are resolved during generation
+    void generateLegalMoves(MoveList& moveList, const GenType type = GenType::ALL, const Bitboard fromMask = ~0ULL) const;
     MoveList generateAllMoves() const;
 
+    // Validates moves that didn't come from the generator (hash move, killers)
+    bool isLegalMove(const Pieces::Move& move, const GenType type = GenType::ALL) const;
+
     void makeMove(const Pieces::Move& move);
     void makeUCIMove(const std::string& UCI_Move);
 
     void undoMove();
 
-    bool isAttacked(const Square square);
-    bool isLegalCastle(const Pieces::Move& move);
-    bool wasIllegalMove();
+    // Passes the turn, for null move pruning
+    void makeNullMove();
+    void undoNullMove();
+
+    // Any piece besides pawns and the king, positions without one are prone to zugzwang
+    bool hasNonPawnMaterial() const;
+
+    bool isInCheck() const;
+
+    // Material won outright: the captured piece plus what a promotion adds
+    int captureGain(const Pieces::Move& move) const;
+
+    // Static exchange evaluation, material balance after all captures on the target square
+    int see(const Pieces::Move& move) const;
 
     // Movegen
     void randomMove();
     int negaMax(int depth);
     int alphaBeta(const int depth, int alpha, const int beta);
 
-    std::string getEngineMove();
+    void flushNodes();
+    void checkLimits();
+    void printInfo(const int depth, const int score);
+    void printOrderingStats() const;
+
+    // Countermove table slot for the opponent's last move, null at the root of a game
+    Pieces::Move* counterMoveEntry() const;
+
+    std::string getEngineMove(const Search::Limits& searchLimits);
 
     uint64_t perft(const int depth);
-    uint64_t divide(const int depth);
+    uint64_t divide(const int depth, const int threadCount = 1, TT::PerftTable* table = nullptr);
+
+    // Same count as perft(), positions reached again by another move order are looked up
+    uint64_t hashedPerft(const int depth, TT::PerftTable& table);
+
+    // Leaf counts below each root move, in generation order. The first two plies are split
+    // into tasks shared by the threads, each searching its own copy of the board
+    std::vector<uint64_t> perftRootMoves(const MoveList& rootMoves, const int depth, const int threadCount, TT::PerftTable* table) const;
+    uint64_t parallelPerft(const int depth, const int threadCount, TT::PerftTable* table = nullptr) const;
 };
@@ -1,3 +1,8 @@
+#include <atomic>
+#include <numeric>
+#include <thread>
+#include <vector>
+
 #include "engine.hpp"
 
 
@@ -13,15 +18,8 @@ uint64_t Engine::perft(const int depth)
     for (int i = 0; i < move_list.used; ++i) {
         const Pieces::Move& move = move_list.moves[i];
 
-        if (!isLegalCastle(move)) continue;
-
         makeMove(move);
 
-        if (wasIllegalMove()) {
-            undoMove();
-            continue;
-        }
-
         nodes += perft(depth - 1);
 
         undoMove();
@@ -31,30 +29,141 @@ uint64_t Engine::perft(const int depth)
 }
 
 
-uint64_t Engine::divide(const int depth)
+uint64_t Engine::hashedPerft(const int depth, TT::PerftTable& table)
 {
-    MoveList move_list = generateAllMoves();
+    if (depth == 0)
+        return 1ULL;
 
-    uint64_t totalNodes = 0;
+    // Legal moves are the leaves, counting them is cheaper than a lookup
+    if (depth == 1)
+        return s_cast(uint64_t, generateAllMoves().used);
+
+    uint64_t nodes = 0;
+
+    if (table.probe(board.key, depth, nodes))
+        return nodes;
+
+    MoveList move_list = generateAllMoves();
 
     for (int i = 0; i < move_list.used; ++i) {
         const Pieces::Move& move = move_list.moves[i];
 
-        if (!isLegalCastle(move)) continue;
-
         makeMove(move);
 
-        if (wasIllegalMove()) {
-            undoMove();
+        nodes += hashedPerft(depth - 1, table);
+
+        undoMove();
+    }
+
+    table.store(board.key, depth, nodes);
+
+    return nodes;
+}
+
+
+uint64_t Engine::divide(const int depth, const int threadCount, TT::PerftTable* table)
+{
+    const MoveList moveList           = generateAllMoves();
+    const std::vector<uint64_t> nodes = perftRootMoves(moveList, depth, threadCount, table);
+
+    uint64_t totalNodes = 0;
+
+    // Printed once all threads are done, always in the same order
+    for (int i = 0; i < moveList.used; ++i) {
+        std::cout << Utils::toUCI(moveList.moves[i]) << ": " << nodes[i] << "\n";
+        totalNodes += nodes[i];
+    }
+
+    return totalNodes;
+}
+
+
+std::vector<uint64_t> Engine::perftRootMoves(const MoveList& rootMoves, const int depth, const int threadCount, TT::PerftTable* table) const
+{
+    std::vector<uint64_t> nodes(rootMoves.used, (depth <= 1) ? 1ULL : 0ULL);
+
+    if (depth <= 1)
+        return nodes;
+
+    // One task per root move, or per reply to a root move when that leaves enough depth to be worth it
+    struct Task
+    {
+        int rootIndex      = 0;
+        Pieces::Move reply = {};
+        uint64_t nodes     = 0;
+    };
+
+    const bool isSplitTwice = (depth >= 3);
+
+    std::vector<Task> tasks;
+    Engine board = *this;
+
+    for (int i = 0; i < rootMoves.used; ++i) {
+        if (!isSplitTwice) {
+            tasks.push_back(Task{.rootIndex = i});
             continue;
         }
 
-        uint64_t moveNodes = perft(depth - 1);
-        std::cout << Utils::toUCI(move) << ": " << moveNodes << "\n";
-        totalNodes += moveNodes;
+        board.makeMove(rootMoves.moves[i]);
 
-        undoMove();
+        const MoveList replies = board.generateAllMoves();
+
+        for (int j = 0; j < replies.used; ++j)
+            tasks.push_back(Task{.rootIndex = i, .reply = replies.moves[j]});
+
+        board.undoMove();
     }
 
-    return totalNodes;
+    std::atomic<std::size_t> nextTask = 0;
+
+    const auto work = [&]() {
+        Engine engine = *this;
+
+        const auto count = [&](const int remaining) {
+            return table ? engine.hashedPerft(remaining, *table) : engine.perft(remaining);
+        };
+
+        for (std::size_t t; (t = nextTask.fetch_add(1, std::memory_order_relaxed)) < tasks.size();) {
+            Task& task = tasks[t];
+
+            engine.makeMove(rootMoves.moves[task.rootIndex]);
+
+            if (isSplitTwice) {
+                engine.makeMove(task.reply);
+                task.nodes = count(depth - 2);
+                engine.undoMove();
+            }
+            else {
+                task.nodes = count(depth - 1);
+            }
+
+            engine.undoMove();
+        }
+    };
+
+    std::vector<std::thread> threads;
+
+    for (int i = 1; i < threadCount; ++i)
+        threads.emplace_back(work);
+
+    work();
+
+    for (std::thread& thread : threads)
+        thread.join();
+
+    for (const Task& task : tasks)
+        nodes[task.rootIndex] += task.nodes;
+
+    return nodes;
+}
+
+
+uint64_t Engine::parallelPerft(const int depth, const int threadCount, TT::PerftTable* table) const
+{
+    if (depth <= 0)
+        return 1ULL;
+
+    const std::vector<uint64_t> nodes = perftRootMoves(generateAllMoves(), depth, threadCount, table);
+
+    return std::accumulate(nodes.begin(), nodes.end(), 0ULL);
 }
@@ -3,11 +3,15 @@
 #include <vector>
 #include <bitset>
 #include <chrono>
+#include <utility>
 
 #include "utils.hpp"
 #include "engine.cpp"
+#include "movepicker.cpp"
 #include "movegen.cpp"
 #include "enginedebug.cpp"
+#include "threads.cpp"
+#include "bench.cpp"
 
 
 #define ifcommand(x) if (command == x)
@@ -59,101 +63,417 @@ std::vector<std::string> splitStr(const std::string& str)
 }
 
 
-int main()
+// Speed summary of perft, divide and bench
+void printSpeed(const uint64_t nodes, const int64_t microseconds)
 {
+    std::cout << "\nTime: " << s_cast(double, microseconds) / 1e6 << "s\n";
+    std::cout << "\nNodes per second: " << nodes * 1000000 / s_cast(uint64_t, std::max<int64_t>(microseconds, 1)) << "\n";
+    std::cout << "\nSlider attacks: " << Attacks::backendName() << "\n\n";
+}
+
+
+// Value following a keyword, like the 4 in "perft 6 threads 4"
+int keywordValue(const std::vector<std::string>& splitCommand, const std::string& keyword, const int defaultValue)
+{
+    for (std::size_t i = 1; i + 1 < splitCommand.size(); ++i) {
+        if (splitCommand[i] == keyword)
+            return std::stoi(splitCommand[i + 1]);
+    }
+
+    return defaultValue;
+}
+
+
+int main(int argc, char* argv[])
+{
+    Attacks::init();
+    Search::initReductions();
+    NNUE::kernel = NNUE::detectKernel();
+
+    TT::table.resize(Settings::defaultHashSize);
+
     Engine engine;
     engine.loadFEN(splitStr(STARTING_FEN));
 
+    // Searches run on the pool so "stop", "ponderhit" and "isready" are read while thinking
+    ThreadPool threads;
+
     std::string command = "";
 
     std::vector<std::string> splitCommand = splitStr(command);
 
-    while (std::getline(std::cin, command)) {
+    bool isInfiniteSearch = false;
+
+    const auto stopSearch = [&]() {
+        Search::stopSignal = true;
+        Search::ponder     = false;
+
+        threads.waitForSearchFinished();
+    };
+
+
+    // Arguments run as a single command instead of reading UCI input, as in "MyEngine.exe bench"
+    std::string argumentCommand;
+
+    for (int i = 1; i < argc; ++i)
+        argumentCommand += (i > 1 ? " " : "") + std::string(argv[i]);
+
+    const auto readCommand = [&]() {
+        if (argc > 1) {
+            command = std::exchange(argumentCommand, "");
+            return !command.empty();
+        }
+
+        return s_cast(bool, std::getline(std::cin, command));
+    };
+
+
+    while (readCommand()) {
         splitCommand = splitStr(command);
 
+        // Anything but these has to wait for the running search to stop
+        if (!command.empty() && command != "isready" && command != "ponderhit")
+            stopSearch();
+
         ifcommand("uci")
         {
             // UCI identification info
             // std::cout << "id name 通常\n";
             // std::cout << "id author ns8\n";
 
-            std::cout << "uciok\n"; // UCI approval
+            // Options
+            std::cout << "option name Hash type spin default " << Settings::defaultHashSize << " min 1 max " << Settings::maxHashSize << "\n";
+            std::cout << "option name Move Overhead type spin default " << Settings::defaultMoveOverhead << " min 0 max " << Settings::maxMoveOverhead << "\n";
+            std::cout << "option name Threads type spin default 1 min 1 max " << Settings::maxThreads << "\n";
+            std::cout << "option name Ponder type check default false\n";
+            std::cout << "option name PVS type check default true\n";
+            std::cout << "option name Aspiration Windows type check default true\n";
+            std::cout << "option name Null Move type check default true\n";
+            std::cout << "option name LMR type check default true\n";
+            std::cout << "option name Reverse Futility type check default true\n";
+            std::cout << "option name Futility type check default true\n";
+            std::cout << "option name EvalFile type string default <empty>\n";
+            std::cout << "option name SyzygyPath type string default <empty>\n";
+            std::cout << "option name BookFile type string default <empty>\n";
+            std::cout << "option name Book Best Move type check default false\n";
+
+            std::cout << "uciok" << std::endl; // UCI approval
         }
 
         elifcommand("isready")
         {
-            std::cout << "readyok\n"; // Engine is ready
+            std::cout << "readyok" << std::endl; // Engine is ready
+        }
+
+        elifcommand("stop")
+        {
+            // Already stopped above, the search thread sends bestmove
+        }
+
+        elifcommand("ponderhit")
+        {
+            // The opponent played the expected move, keep searching on our own clock
+            Search::ponder = false;
+        }
+
+        elifcommand("ucinewgame")
+        {
+            TT::table.clear();
+            threads.clear();
+        }
+
+        elifsplitcommand(0, "setoption")
+        {
+            // setoption name <id> [value <x>], <id> may contain spaces
+            std::string name;
+            std::string value;
+
+            std::size_t i = 2;
+            for (; i < splitCommand.size() && splitCommand[i] != "value"; ++i)
+                name += (name.empty() ? "" : " ") + splitCommand[i];
+            for (++i; i < splitCommand.size(); ++i)
+                value += (value.empty() ? "" : " ") + splitCommand[i];
+
+            if (name == "Hash")
+                TT::table.resize(std::clamp(std::stoi(value), 1, Settings::maxHashSize));
+
+            else if (name == "Threads")
+                threads.setThreadCount(std::clamp(std::stoi(value), 1, Settings::maxThreads));
+
+            else if (name == "Move Overhead")
+                engine.timeManager.moveOverhead = std::clamp(std::stoi(value), 0, Settings::maxMoveOverhead);
+
+            else if (name == "PVS")
+                Search::options.pvs = (value == "true");
+
+            else if (name == "Aspiration Windows")
+                Search::options.aspiration = (value == "true");
+
+            else if (name == "Null Move")
+                Search::options.nullMove = (value == "true");
+
+            else if (name == "LMR")
+                Search::options.lmr = (value == "true");
+
+            else if (name == "Reverse Futility")
+                Search::options.reverseFutility = (value == "true");
+
+            else if (name == "Futility")
+                Search::options.futility = (value == "true");
+
+            else if (name == "EvalFile") {
+                std::string error;
+
+                if (value.empty() || value == "<empty>") {
+                    NNUE::network.unload();
+                    std::cout << "info string classical evaluation" << std::endl;
+                }
+                else if (NNUE::network.load(value, error))
+                    std::cout << "info string NNUE evaluation using " << value << " (" << NNUE::kernelName() << ")" << std::endl;
+                else
+                    std::cout << "info string " << error << ", " << (NNUE::network.loaded ? "keeping " + NNUE::network.path : "classical evaluation") << std::endl;
+
+                // Accumulators from another network are no good
+                engine.resetAccumulators();
+            }
+
+            else if (name == "SyzygyPath")
+                Syzygy::init(value);
+
+            else if (name == "BookFile") {
+                std::string error;
+
+                if (value.empty() || value == "<empty>") {
+                    Book::book.unload();
+                    std::cout << "info string no book" << std::endl;
+                }
+                else if (Book::book.load(value, error))
+                    std::cout << "info string book " << value << " (" << Book::book.size() << " entries)" << std::endl;
+                else
+                    std::cout << "info string " << error << ", " << (Book::book.loaded ? "keeping " + Book::book.path : "no book") << std::endl;
+            }
+
+            else if (name == "Book Best Move")
+                Book::book.bestMove = (value == "true");
+        }
+
+        elifsplitcommand(0, "debug")
+        {
+            if (splitCommand.size() > 1)
+                engine.debugMode = (splitCommand[1] == "on");
         }
 
         elifsplitcommand(0, "position")
         {
+            // position [startpos | fen <fen>] moves <move1> ... <movei>
+            std::size_t movesIndex = 2;
+            while (movesIndex < splitCommand.size() && splitCommand[movesIndex] != "moves")
+                ++movesIndex;
+
             ifsplitcommand(1, "startpos")
             {
-                if (splitCommand.size() == 2) {
-                    engine.loadFEN(splitStr(STARTING_FEN));
-                    engine.setColor(true);
-                }
-                else if (splitCommand.size() > 2) {
-                    engine.makeUCIMove(splitCommand[splitCommand.size() - 1]);
-                }
+                engine.loadFEN(splitStr(STARTING_FEN));
             }
 
             elifsplitcommand(1, "fen")
             {
-                if (splitCommand.size() == 8) {
-                    std::vector<std::string> fen = {
-                        splitCommand[2],
-                        splitCommand[3],
-                        splitCommand[4],
-                        splitCommand[5],
-                        splitCommand[6],
-                        splitCommand[7],
-                    };
-                    engine.loadFEN(fen);
-                }
-                else if (splitCommand.size() > 8) {
-                    engine.makeUCIMove(splitCommand[splitCommand.size() - 1]);
-                }
+                std::vector<std::string> fen(splitCommand.begin() + 2, splitCommand.begin() + movesIndex);
+
+                // Fill in missing fields (castling, en passant, clocks)
+                const std::vector<std::string> defaults = {"", "w", "-", "-", "0", "1"};
+                while (fen.size() < defaults.size())
+                    fen.push_back(defaults[fen.size()]);
+
+                engine.loadFEN(fen);
             }
+
+            for (std::size_t i = movesIndex + 1; i < splitCommand.size(); ++i)
+                engine.makeUCIMove(splitCommand[i]);
         }
 
         elifsplitcommand(0, "go")
         {
-            // Send bestmove (move that will be played by the engine)
-            std::string uciMove = engine.getEngineMove();
-            std::cout << "bestmove " << uciMove << "\n";
+            // go [wtime <x>] [btime <x>] [winc <x>] [binc <x>] [movestogo <x>]
+            //    [depth <x>] [nodes <x>] [movetime <x>] [infinite] [ponder]
+            Search::Limits limits;
+            bool isLimited = false;
+            bool isPonder  = false;
+
+            for (std::size_t i = 1; i < splitCommand.size(); ++i) {
+                const bool hasValue = (i + 1 < splitCommand.size());
+
+                ifsplitcommand(i, "depth")
+                {
+                    if (hasValue) limits.depth = std::clamp(std::stoi(splitCommand[++i]), 1, Settings::maxPly - 1);
+                    isLimited = true;
+                }
+                elifsplitcommand(i, "nodes")
+                {
+                    if (hasValue) limits.nodes = std::stoull(splitCommand[++i]);
+                    isLimited = true;
+                }
+                elifsplitcommand(i, "movetime")
+                {
+                    if (hasValue) limits.movetime = std::stoll(splitCommand[++i]);
+                    isLimited = true;
+                }
+                elifsplitcommand(i, "wtime")
+                {
+                    if (hasValue) limits.time[1] = std::stoll(splitCommand[++i]);
+                    limits.hasClock = true;
+                    isLimited       = true;
+                }
+                elifsplitcommand(i, "btime")
+                {
+                    if (hasValue) limits.time[0] = std::stoll(splitCommand[++i]);
+                    limits.hasClock = true;
+                    isLimited       = true;
+                }
+                elifsplitcommand(i, "winc")
+                {
+                    if (hasValue) limits.inc[1] = std::stoll(splitCommand[++i]);
+                }
+                elifsplitcommand(i, "binc")
+                {
+                    if (hasValue) limits.inc[0] = std::stoll(splitCommand[++i]);
+                }
+                elifsplitcommand(i, "movestogo")
+                {
+                    if (hasValue) limits.movesToGo = std::stoi(splitCommand[++i]);
+                }
+                elifsplitcommand(i, "infinite")
+                {
+                    limits.infinite = true;
+                    isLimited       = true;
+                }
+                elifsplitcommand(i, "ponder")
+                {
+                    isPonder = true;
+                }
+            }
+
+            if (!isLimited)
+                limits.depth = Settings::defaultDepth;
+
+            // Book moves are played without searching, except when the GUI expects to stop the search itself
+            if (!limits.infinite && !isPonder) {
+                const Pieces::Move bookMove = Book::book.probe(engine);
+
+                if (!bookMove.isNull()) {
+                    std::cout << "bestmove " << Utils::toUCI(bookMove) << std::endl;
+                    continue;
+                }
+            }
+
+            isInfiniteSearch = limits.infinite;
+            Search::ponder   = isPonder;
+
+            threads.startSearch(engine, limits);
+        }
+
+        elifsplitcommand(0, "bookkeys")
+        {
+            // Checks the book key against the Polyglot reference positions
+            const bool passed = Book::checkKeys();
+
+            std::cout << "info string book keys " << (passed ? "ok" : "wrong") << std::endl;
+        }
+
+        elifsplitcommand(0, "tbcheck")
+        {
+            // Checks the tablebase probes against known results, positions without tables are skipped
+            const Syzygy::CheckResult result = Syzygy::checkProbes();
+
+            if (!result.probed)
+                std::cout << "info string tbcheck skipped (no tables)" << std::endl;
+            else
+                std::cout << "info string tbcheck " << (result.wrong ? "wrong" : "ok") << ", " << result.probed << " of "
+                          << result.positions << " positions probed, " << result.wrong << " wrong" << std::endl;
+        }
+
+        elifsplitcommand(0, "makebook")
+        {
+            // makebook <pgn> <book> [plies] [min games] [threads]
+            if (splitCommand.size() < 3) {
+                std::cout << "info string makebook <pgn> <book> [plies] [min games] [threads]" << std::endl;
+                continue;
+            }
+
+            Book::MakeOptions options;
+            options.threads = s_cast(int, std::max(std::thread::hardware_concurrency(), 1U));
+
+            if (splitCommand.size() > 3) options.maxPlies = std::clamp(std::stoi(splitCommand[3]), 1, Settings::maxPly);
+            if (splitCommand.size() > 4) options.minGames = std::max(std::stoi(splitCommand[4]), 1);
+            if (splitCommand.size() > 5) options.threads = std::clamp(std::stoi(splitCommand[5]), 1, Settings::maxThreads);
+
+            std::string error;
+
+            if (!Book::make(splitCommand[1], splitCommand[2], options, error))
+                std::cout << "info string " << error << std::endl;
+        }
+
+        elifsplitcommand(0, "bench")
+        {
+            // bench [depth] [threads] [hash]
+            const int depth       = (splitCommand.size() > 1) ? std::clamp(std::stoi(splitCommand[1]), 1, Settings::maxPly - 1) : Bench::defaultDepth;
+            const int threadCount = (splitCommand.size() > 2) ? std::clamp(std::stoi(splitCommand[2]), 1, Settings::maxThreads) : 1;
+            const int hashSize    = (splitCommand.size() > 3) ? std::clamp(std::stoi(splitCommand[3]), 1, Settings::maxHashSize) : Settings::defaultHashSize;
+
+            const Bench::Result result = Bench::run(threads, depth, threadCount, hashSize);
+
+            std::cout << "\nTotal nodes: " << result.nodes << "\n";
+            std::cout << "\nSignature: " << std::hex << result.signature << std::dec << "\n";
+            printSpeed(result.nodes, result.microseconds);
         }
 
         elifsplitcommand(0, "perft")
         {
-            const auto start = std::chrono::high_resolution_clock::now();
+            // perft <depth> [threads <n>] [hash <MB>]
+            const int depth       = std::stoi(splitCommand[1]);
+            const int threadCount = std::clamp(keywordValue(splitCommand, "threads", 1), 1, Settings::maxThreads);
+            const int hashSize    = std::clamp(keywordValue(splitCommand, "hash", 0), 0, Settings::maxHashSize);
+
+            TT::PerftTable perftTable;
+            TT::PerftTable* table = hashSize ? &perftTable : nullptr;
 
-            const uint64_t nodes = engine.perft(std::stoi(splitCommand[1]));
+            if (table)
+                table->resize(hashSize);
 
-            const auto end = std::chrono::high_resolution_clock::now();
+            const auto start = std::chrono::steady_clock::now();
 
-            const double time = s_cast(double, std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()) / 1000.0;
+            const uint64_t nodes = (threadCount > 1) ? engine.parallelPerft(depth, threadCount, table)
+                                 : table             ? engine.hashedPerft(depth, *table)
+                                                     : engine.perft(depth);
+
+            const auto end = std::chrono::steady_clock::now();
 
             std::cout << "\nTotal nodes: " << nodes << "\n";
-            std::cout << "\nTime: " << time << "s\n";
-            std::cout << "\nNodes per second: " << s_cast(uint64_t, s_cast(double, nodes) / time) << "\n\n";
+            printSpeed(nodes, std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
         }
 
         elifsplitcommand(0, "divide")
         {
-            printf("\n");
+            // divide <depth> [threads <n>] [hash <MB>]
+            const int depth       = std::stoi(splitCommand[1]);
+            const int threadCount = std::clamp(keywordValue(splitCommand, "threads", 1), 1, Settings::maxThreads);
+            const int hashSize    = std::clamp(keywordValue(splitCommand, "hash", 0), 0, Settings::maxHashSize);
 
-            const auto start = std::chrono::high_resolution_clock::now();
+            TT::PerftTable perftTable;
+            TT::PerftTable* table = hashSize ? &perftTable : nullptr;
 
-            const uint64_t nodes = engine.divide(std::stoi(splitCommand[1]));
+            if (table)
+                table->resize(hashSize);
+
+            printf("\n");
 
-            const auto end = std::chrono::high_resolution_clock::now();
+            const auto start = std::chrono::steady_clock::now();
 
-            const double time = s_cast(double, std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()) / 1000.0;
+            const uint64_t nodes = engine.divide(depth, threadCount, table);
+
+            const auto end = std::chrono::steady_clock::now();
 
             std::cout << "\nTotal nodes: " << nodes << "\n\n";
-            std::cout << "\nTime: " << time << "s\n";
-            std::cout << "\nNodes per second: " << s_cast(uint64_t, s_cast(double, nodes) / time) << "\n\n";
+            printSpeed(nodes, std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
         }
 
         elifsplitcommand(0, "print")
@@ -248,4 +568,11 @@ int main()
             std::cout << "Unknown command: " << command << "\n";
         }
     }
+
+
+    // End of input: let a finite search finish and print its move
+    if (isInfiniteSearch)
+        stopSearch();
+    else
+        threads.waitForSearchFinished();
 }
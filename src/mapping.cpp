@@ -0,0 +1,87 @@
+#ifdef _WIN32
+    #define NOMINMAX
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#include "mapping.hpp"
+#include "utils.hpp"
+
+
+namespace Mapping
+{
+
+    bool File::open(const std::string& path)
+    {
+        close();
+
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+            CloseHandle(file);
+            return false;
+        }
+
+        HANDLE fileMapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file);
+        if (!fileMapping)
+            return false;
+
+        // The view keeps the mapping alive
+        void* mapping = MapViewOfFile(fileMapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(fileMapping);
+        if (!mapping)
+            return false;
+
+        data = s_cast(const uint8_t*, mapping);
+        size = s_cast(std::size_t, fileSize.QuadPart);
+#else
+        const int file = ::open(path.c_str(), O_RDONLY);
+        if (file == -1)
+            return false;
+
+        struct stat status;
+        if (fstat(file, &status) == -1 || status.st_size == 0) {
+            ::close(file);
+            return false;
+        }
+
+        void* mapping = mmap(nullptr, s_cast(std::size_t, status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+        ::close(file);
+
+        if (mapping == MAP_FAILED)
+            return false;
+
+        data = s_cast(const uint8_t*, mapping);
+        size = s_cast(std::size_t, status.st_size);
+#endif
+
+        return true;
+    }
+
+
+    void File::close()
+    {
+        if (!data)
+            return;
+
+#ifdef _WIN32
+        UnmapViewOfFile(data);
+#else
+        munmap(const_cast<uint8_t*>(data), size);
+#endif
+
+        data = nullptr;
+        size = 0;
+    }
+
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+
+namespace Mapping
+{
+
+    /*
+        Read-only memory mapping of a whole file
+
+        Pages are only read from disk when touched and are shared with
+        every other process mapping the same file, so large data files
+        (networks, tablebases, books) cost nothing until they are used.
+        Not closed on destruction, the owner calls close().
+    */
+
+    struct File
+    {
+        const uint8_t* data = nullptr;
+        std::size_t size    = 0;
+
+        // False if the file is missing or empty
+        bool open(const std::string& path);
+        void close();
+    };
+
+}
@@ -1,69 +1,86 @@
 #include "engine.hpp"
+#include "movepicker.hpp"
 
 
 int Engine::quiescentSearch(int alpha, const int beta)
 {
-    int stand_pat = evaluateBoard();
+    const int ply = board.plyCount - rootPly;
 
-    if (stand_pat >= beta)
-        return beta;
+    pv.clear(ply);
 
-    if (alpha < stand_pat)
-        alpha = stand_pat;
+    ++nodes;
 
-    // alpha = std::max(alpha, stand_pat);
+    if ((nodes & 1023) == 0 || (limits.nodes && nodes >= limits.nodes))
+        checkLimits();
 
-    MoveList moves = generateAllMoves();
+    if (stopped)
+        return 0;
 
-    for (int i = 0; i < moves.used; ++i) {
-        Pieces::Move move = moves.moves[i];
+    if (ply >= Settings::maxPly - 1)
+        return evaluateBoard();
 
-        if (board.mailbox[move.toSquare] == Pieces::Piece::NONE) continue;
 
-        makeMove(move);
+    // In check every evasion is searched and there is no standing pat
+    const bool inCheck = isInCheck();
 
-        int score = -quiescentSearch(-beta, -alpha);
+    int bestValue = -Settings::infinity;
+    int standPat  = 0;
 
-        undoMove();
+    if (!inCheck) {
+        standPat = evaluateBoard();
 
-        if (score >= beta)
-            return beta;
+        if (standPat >= beta)
+            return standPat;
 
-        // alpha = std::max(alpha, score);
+        if (standPat > alpha)
+            alpha = standPat;
 
-        if (score > alpha)
-            alpha = score;
+        bestValue = standPat;
     }
 
-    return alpha;
-}
-
+    MovePicker picker = inCheck ? MovePicker(*this, Pieces::Move{}, nullptr, Pieces::Move{}) : MovePicker(*this);
+    Pieces::Move move;
 
+    while (picker.next(move)) {
+        // Delta pruning, even winning the piece outright wouldn't reach alpha
+        if (!inCheck && standPat + captureGain(move) + Settings::deltaMargin <= alpha)
+            continue;
 
-void Engine::randomMove()
-{
-    MoveList moves = generateAllMoves();
+        makeMove(move);
 
-    MoveList legalMoves = {};
+        const int score = -quiescentSearch(-beta, -alpha);
 
-    for (int i = 0; i < moves.used; ++i) {
-        const Pieces::Move& move = moves.moves[i];
+        undoMove();
 
-        if (!isLegalCastle(move)) continue;
+        if (stopped)
+            return 0;
 
-        makeMove(move);
+        if (score > bestValue) {
+            bestValue = score;
 
-        if (wasIllegalMove()) {
-            undoMove();
-            continue;
+            if (score > alpha)
+                alpha = score;
         }
 
-        legalMoves.moves[legalMoves.used++] = move;
-
-        undoMove();
+        if (score >= beta)
+            break;
     }
 
-    bestMove = legalMoves.moves[Utils::randomInt(0, legalMoves.used - 1)];
+    // Checkmated, the only way to run out of evasions
+    if (bestValue == -Settings::infinity)
+        return -Settings::mateScore + ply;
+
+    return bestValue;
+}
+
+
+
+void Engine::randomMove()
+{
+    MoveList moves = generateAllMoves();
+
+    if (moves.used > 0)
+        bestMove = moves.moves[Utils::randomInt(0, moves.used - 1)];
 }
 
 
@@ -78,21 +95,14 @@ int Engine::negaMax(int depth)
     for (int i = 0; i < moves.used; ++i) {
         const Pieces::Move& move = moves.moves[i];
 
-        if (!isLegalCastle(move)) continue;
-
         makeMove(move);
 
-        if (wasIllegalMove()) {
-            undoMove();
-            continue;
-        }
-
         int score = -negaMax(depth - 1);
 
         undoMove();
 
         if (score > max) {
-            if (depth == Settings::maxPlyDepth)
+            if (board.plyCount == rootPly)
                 bestMove = move;
 
             max = score;
@@ -105,42 +115,235 @@ int Engine::negaMax(int depth)
 
 int Engine::alphaBeta(const int depth, int alpha, const int beta)
 {
-    if (depth == 0)
-        // return quiescentSearch(alpha, beta);
+    // Resolve captures before trusting the evaluation
+    if (depth <= 0)
+        return quiescentSearch(alpha, beta);
+
+    const int ply = board.plyCount - rootPly;
+
+    pv.clear(ply);
+
+    ++nodes;
+
+    // Poll the clock every 1024 nodes
+    if ((nodes & 1023) == 0 || (limits.nodes && nodes >= limits.nodes))
+        checkLimits();
+
+    if (stopped)
+        return 0;
+
+    if (ply >= Settings::maxPly - 1)
         return evaluateBoard();
 
-    int bestValue = -std::numeric_limits<int>::max();
+    const int alphaOriginal = alpha;
 
-    MoveList moves = generateAllMoves();
 
-    for (int i = 0; i < moves.used; ++i) {
-        const Pieces::Move& move = moves.moves[i];
+    // Transposition table
+    TT::EntryData entry;
+    Pieces::Move hashMove = {};
 
-        if (!isLegalCastle(move)) continue;
+    if (TT::table.probe(board.key, entry)) {
+        hashMove = Pieces::Move::fromData(entry.move);
 
-        makeMove(move);
+        // Never cut at the root, it has to pick a move
+        if (ply > 0 && entry.depth >= depth) {
+            const int score = TT::scoreFromTT(entry.score, ply);
+
+            if ((entry.bound() == TT::BOUND_EXACT) ||
+                (entry.bound() == TT::BOUND_LOWER && score >= beta) ||
+                (entry.bound() == TT::BOUND_UPPER && score <= alpha))
+                return score;
+        }
+    }
+
+
+    // Tablebases, exact results with few pieces left. Cursed wins and blessed losses count as draws.
+    // WDL assumes a zeroed 50-move count, so only positions right after a capture or pawn move are probed
+    const int pieceCount = std::popcount(board.occupiedSquares[0] | board.occupiedSquares[1]);
+
+    if (ply > 0 && pieceCount <= tbCardinality && !board.castlingFlags && !board.halfmoveClock) {
+        bool success;
+        const Syzygy::WDL wdl = Syzygy::probeWDL(*this, success);
+
+        if (success) {
+            Search::tbHits.fetch_add(1, std::memory_order_relaxed);
+
+            const int score = (wdl == Syzygy::WDL::WIN)  ? Settings::tbWinScore - ply
+                            : (wdl == Syzygy::WDL::LOSS) ? -Settings::tbWinScore + ply
+                                                         : 0;
+
+            const TT::Bound bound = (wdl == Syzygy::WDL::WIN)  ? TT::BOUND_LOWER
+                                  : (wdl == Syzygy::WDL::LOSS) ? TT::BOUND_UPPER
+                                                               : TT::BOUND_EXACT;
+
+            if (bound == TT::BOUND_EXACT || (bound == TT::BOUND_LOWER && score >= beta) || (bound == TT::BOUND_UPPER && score <= alpha)) {
+                TT::table.store(board.key, TT::scoreToTT(score, ply), bound, std::min(depth + 6, Settings::maxPly - 1), 0);
+                return score;
+            }
+        }
+    }
+
+
+    const bool isPvNode = (beta - alpha > 1);
+    const bool inCheck  = isInCheck();
+
+    const int staticEval = inCheck ? -Settings::infinity : evaluateBoard();
+
+
+    // Reverse futility, the position is so far above beta that a shallow search won't bring it back down
+    if (Search::options.reverseFutility && !isPvNode && !inCheck && depth <= Settings::reverseFutilityDepth &&
+        std::abs(beta) < Settings::mateScore - Settings::maxPly &&
+        staticEval - Settings::reverseFutilityMargin * depth >= beta)
+        return staticEval;
+
+
+    // Null move, if passing still fails high a real move would too. Not with only pawns left,
+    // those positions are where having to move can be a disadvantage
+    const bool isAfterNullMove = board.history.used && board.history.history[board.history.used - 1].move.isNull();
+
+    if (Search::options.nullMove && !isPvNode && !inCheck && depth >= Settings::nullMoveMinDepth &&
+        !isAfterNullMove && staticEval >= beta && hasNonPawnMaterial()) {
+        const int reduction = 3 + depth / 6;
+
+        makeNullMove();
+        const int score = -alphaBeta(depth - 1 - reduction, -beta, -beta + 1);
+        undoNullMove();
+
+        if (stopped)
+            return 0;
+
+        // Don't trust a mate found after passing
+        if (score >= beta)
+            return (score >= Settings::mateScore - Settings::maxPly) ? beta : score;
+    }
 
-        if (wasIllegalMove()) {
-            undoMove();
+
+    int bestValue = -Settings::infinity;
+    Pieces::Move bestNodeMove = {};
+
+    Search::Heuristics& heuristics = *this->heuristics;
+
+    Pieces::Move* const counterEntry = counterMoveEntry();
+    const Pieces::Move counterMove   = counterEntry ? *counterEntry : Pieces::Move{};
+
+    MovePicker picker(*this, hashMove, heuristics.killers[ply], counterMove);
+    Pieces::Move move;
+
+    int moveCount = 0;
+
+    // Quiets that didn't cut off, penalised if a later quiet does
+    Pieces::Move quietsTried[64];
+    int quietsTriedCount = 0;
+
+    while (picker.next(move)) {
+        if (ply == 0 && rootMoves.used && std::find(rootMoves.moves, rootMoves.moves + rootMoves.used, move) == rootMoves.moves + rootMoves.used)
             continue;
+
+        ++moveCount;
+
+        const bool isQuiet = (captureGain(move) == 0);
+
+        // Futility, near the leaves a quiet move won't lift a hopeless position above alpha
+        if (Search::options.futility && !isPvNode && !inCheck && isQuiet && moveCount > 1 &&
+            depth <= Settings::futilityDepth && staticEval + Settings::futilityMargin * depth <= alpha)
+            continue;
+
+        // Late quiet moves are searched shallower first, more so for ones that hang the moving piece
+        int reduction = 0;
+
+        if (isQuiet && depth >= 3 && moveCount > 1 && !inCheck) {
+            if (Search::options.lmr)
+                reduction = Search::reductions[std::min(depth, 63)][std::min(moveCount, 63)] - isPvNode;
+
+            if (see(move) < 0)
+                ++reduction;
+
+            reduction = std::clamp(reduction, 0, depth - 2);
+        }
+
+        makeMove(move);
+
+        int score;
+
+        if (moveCount == 1) {
+            score = -alphaBeta(depth - 1, -beta, -alpha);
+        }
+        else if (Search::options.pvs) {
+            // Principal variation search, prove the move is worse with a zero window
+            score = -alphaBeta(depth - 1 - reduction, -alpha - 1, -alpha);
+
+            if (reduction && score > alpha && !stopped)
+                score = -alphaBeta(depth - 1, -alpha - 1, -alpha);
+
+            if (score > alpha && score < beta && !stopped)
+                score = -alphaBeta(depth - 1, -beta, -alpha);
         }
+        else {
+            score = -alphaBeta(depth - 1 - reduction, -beta, -alpha);
 
-        int score = -alphaBeta(depth - 1, -beta, -alpha);
+            if (reduction && score > alpha && !stopped)
+                score = -alphaBeta(depth - 1, -beta, -alpha);
+        }
 
         undoMove();
 
+        if (stopped)
+            return 0;
+
         if (score > bestValue) {
-            bestValue = score;
+            bestValue    = score;
+            bestNodeMove = move;
 
-            if (depth == Settings::maxPlyDepth)
-                bestMove = move;
+            if (score > alpha) {
+                alpha = score;
+                pv.update(ply, move);
+            }
+        }
 
-            alpha = std::max(alpha, score);
+        if (score >= beta) {
+            ++heuristics.cutoffs;
+
+            if (isQuiet) {
+                ++heuristics.quietCutoffs;
+
+                if (move == heuristics.killers[ply][0] || move == heuristics.killers[ply][1])
+                    ++heuristics.killerHits;
+                else if (move == counterMove)
+                    ++heuristics.counterHits;
+                else if (picker.quietsPicked == 1)
+                    ++heuristics.historyHits;
+
+                const int bonus = std::min(depth * depth, 1200);
+
+                heuristics.updateHistory(isWhiteTurn, move, bonus);
+
+                for (int i = 0; i < quietsTriedCount; ++i)
+                    heuristics.updateHistory(isWhiteTurn, quietsTried[i], -bonus);
+
+                heuristics.updateKillers(ply, move);
+
+                if (counterEntry)
+                    *counterEntry = move;
+            }
+
+            break;
         }
 
-        if (score >= beta)
-            return bestValue;
+        if (isQuiet && quietsTriedCount < 64)
+            quietsTried[quietsTriedCount++] = move;
     }
 
+
+    // No legal moves, checkmate or stalemate
+    if (bestValue == -Settings::infinity)
+        return isInCheck() ? -Settings::mateScore + ply : 0;
+
+
+    const TT::Bound bound = (bestValue >= beta)          ? TT::BOUND_LOWER
+                          : (bestValue > alphaOriginal) ? TT::BOUND_EXACT
+                                                        : TT::BOUND_UPPER;
+
+    TT::table.store(board.key, TT::scoreToTT(bestValue, ply), bound, depth, bestNodeMove.data);
+
     return bestValue;
 }
@@ -0,0 +1,173 @@
+#include "movepicker.hpp"
+
+
+MovePicker::MovePicker(const Engine& engine, const Pieces::Move& hashMove, const Pieces::Move* killers, const Pieces::Move& counterMove)
+    : engine(engine), hashMove(hashMove)
+{
+    refutations[0] = killers ? killers[0] : Pieces::Move{};
+    refutations[1] = killers ? killers[1] : Pieces::Move{};
+    refutations[2] = counterMove;
+}
+
+
+MovePicker::MovePicker(const Engine& engine)
+    : engine(engine), hashMove(), refutations(), capturesOnly(true)
+{
+    stage = Stage::GENERATE_CAPTURES;
+}
+
+
+int MovePicker::captureScore(const Pieces::Move& move) const
+{
+    // MVV-LVA, promotions rank by the piece they make
+    return 8 * engine.captureGain(move) - (engine.board.mailbox[move.from()] >> 1);
+}
+
+
+bool MovePicker::isGoodCapture(const Pieces::Move& move) const
+{
+    // Under-promotions are almost never the best move
+    if (move.isPromotion() && move.flag() != Pieces::MoveFlag::PROMOTION_QUEEN)
+        return false;
+
+    return engine.see(move) >= 0;
+}
+
+
+void MovePicker::selectBest()
+{
+    int best = current;
+
+    for (int i = current + 1; i < end; ++i) {
+        if (scores[i] > scores[best])
+            best = i;
+    }
+
+    std::swap(list.moves[current], list.moves[best]);
+    std::swap(scores[current], scores[best]);
+}
+
+
+bool MovePicker::isRefutation(const Pieces::Move& move) const
+{
+    return move == refutations[0] || move == refutations[1] || move == refutations[2];
+}
+
+
+bool MovePicker::next(Pieces::Move& move)
+{
+    switch (stage) {
+        case Stage::HASH_MOVE:
+            stage = Stage::GENERATE_CAPTURES;
+
+            if (!hashMove.isNull() && engine.isLegalMove(hashMove)) {
+                move = hashMove;
+                return true;
+            }
+            [[fallthrough]];
+
+        case Stage::GENERATE_CAPTURES:
+            list.used = 0;
+            engine.generateLegalMoves(list, Engine::GenType::CAPTURES);
+
+            for (int i = 0; i < list.used; ++i)
+                scores[i] = captureScore(list.moves[i]);
+
+            current = 0;
+            end     = list.used;
+            stage   = Stage::GOOD_CAPTURES;
+            [[fallthrough]];
+
+        case Stage::GOOD_CAPTURES:
+            while (current < end) {
+                selectBest();
+
+                const Pieces::Move& candidate = list.moves[current++];
+
+                if (candidate == hashMove)
+                    continue;
+
+                if (!isGoodCapture(candidate)) {
+                    // Consumed slots are free, keep it there for the last stage
+                    list.moves[badCaptures++] = candidate;
+                    continue;
+                }
+
+                move = candidate;
+                return true;
+            }
+
+            // Quiescence doesn't search losing captures at all
+            if (capturesOnly) {
+                stage = Stage::DONE;
+                return false;
+            }
+
+            stage = Stage::REFUTATIONS;
+            [[fallthrough]];
+
+        case Stage::REFUTATIONS:
+            while (refutationIndex < 3) {
+                const int index                = refutationIndex++;
+                const Pieces::Move& refutation = refutations[index];
+
+                // The countermove may also be one of the killers
+                if (index == 2 && (refutation == refutations[0] || refutation == refutations[1]))
+                    continue;
+
+                if (!refutation.isNull() && refutation != hashMove &&
+                    engine.isLegalMove(refutation, Engine::GenType::QUIETS)) {
+                    move = refutation;
+                    return true;
+                }
+            }
+
+            stage = Stage::GENERATE_QUIETS;
+            [[fallthrough]];
+
+        case Stage::GENERATE_QUIETS:
+            list.used = badCaptures;
+            engine.generateLegalMoves(list, Engine::GenType::QUIETS);
+
+            for (int i = badCaptures; i < list.used; ++i)
+                scores[i] = engine.heuristics ? engine.heuristics->history[engine.isWhiteTurn][list.moves[i].from()][list.moves[i].to()] : 0;
+
+            current = badCaptures;
+            end     = list.used;
+            stage   = Stage::QUIETS;
+            [[fallthrough]];
+
+        case Stage::QUIETS:
+            while (current < end) {
+                selectBest();
+
+                const Pieces::Move& candidate = list.moves[current++];
+
+                if (candidate == hashMove || isRefutation(candidate))
+                    continue;
+
+                ++quietsPicked;
+                move = candidate;
+                return true;
+            }
+
+            current = 0;
+            stage   = Stage::BAD_CAPTURES;
+            [[fallthrough]];
+
+        case Stage::BAD_CAPTURES:
+            // Already in MVV-LVA order
+            if (current < badCaptures) {
+                move = list.moves[current++];
+                return true;
+            }
+
+            stage = Stage::DONE;
+            [[fallthrough]];
+
+        case Stage::DONE:
+            return false;
+    }
+
+    return false;
+}
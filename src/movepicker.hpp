@@ -0,0 +1,77 @@
+#pragma once
+#include <cstdint>
+
+#include "engine.hpp"
+#include "pieces.hpp"
+
+
+/*
+    Staged move picker
+
+    Hands out the moves of a node one at a time, best guess first:
+
+        HASH_MOVE       from the transposition table, checked for legality
+        GOOD_CAPTURES   captures and promotions that don't lose material
+        REFUTATIONS     the two killers and the countermove
+        QUIETS          the remaining quiet moves, by history score
+        BAD_CAPTURES    captures that were put aside as losing
+
+    Captures are ordered by MVV-LVA and split into good and bad by SEE.
+    The quiescence picker only hands out the good captures.
+
+    Captures and quiets are only generated once the stage before them runs
+    dry, and each pick scans the rest of the list for the highest score
+    instead of sorting it. A node that cuts off on the hash move never
+    generates anything.
+*/
+
+struct MovePicker
+{
+    enum class Stage
+    {
+        HASH_MOVE,
+        GENERATE_CAPTURES,
+        GOOD_CAPTURES,
+        REFUTATIONS,
+        GENERATE_QUIETS,
+        QUIETS,
+        BAD_CAPTURES,
+        DONE
+    };
+
+    const Engine& engine;
+
+    Pieces::Move hashMove;
+    Pieces::Move refutations[3]; // Killers, then the countermove
+
+    Stage stage = Stage::HASH_MOVE;
+
+    // Quiescence: only captures and promotions, no hash move or killers
+    bool capturesOnly = false;
+
+    // Bad captures are moved to the front of the list as they come up,
+    // quiets are generated behind them
+    Engine::MoveList list;
+    int scores[256];
+
+    int current         = 0;
+    int end             = 0;
+    int badCaptures     = 0;
+    int refutationIndex = 0;
+    int quietsPicked    = 0; // Handed out by the QUIETS stage so far
+
+    // killers may be null
+    MovePicker(const Engine& engine, const Pieces::Move& hashMove, const Pieces::Move* killers, const Pieces::Move& counterMove);
+    explicit MovePicker(const Engine& engine);
+
+    // False once every move has been handed out
+    [[nodiscard]] bool next(Pieces::Move& move);
+
+    [[nodiscard]] int captureScore(const Pieces::Move& move) const;
+    [[nodiscard]] bool isGoodCapture(const Pieces::Move& move) const;
+
+    // Swaps the highest scored move left into the current slot
+    void selectBest();
+
+    [[nodiscard]] bool isRefutation(const Pieces::Move& move) const;
+};
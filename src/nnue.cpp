@@ -0,0 +1,472 @@
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+#ifdef NNUE_HAS_X86
+    #include <immintrin.h>
+#endif
+
+#include "nnue.hpp"
+#include "board.hpp"
+#include "settings.hpp"
+
+
+namespace NNUE
+{
+
+    constexpr std::size_t rowBytes = halfDimensions * sizeof(int16_t);
+
+    constexpr std::size_t headerBytes      = 3 * sizeof(uint32_t); // Not counting the description
+    constexpr std::size_t transformerBytes = sizeof(uint32_t) + rowBytes + s_cast(std::size_t, inputDimensions) * rowBytes;
+    constexpr std::size_t networkBytes     = sizeof(uint32_t) +
+                                             l1Dimensions * (sizeof(int32_t) + 2 * halfDimensions) +
+                                             l2Dimensions * (sizeof(int32_t) + l1Dimensions) +
+                                             sizeof(int32_t) + l2Dimensions;
+
+
+    Kernel detectKernel()
+    {
+#ifdef NNUE_HAS_X86
+        // Also checks that the OS saves the wide registers
+        if (__builtin_cpu_supports("avx2"))
+            return Kernel::AVX2;
+
+        if (__builtin_cpu_supports("sse4.1"))
+            return Kernel::SSE41;
+#endif
+        return Kernel::SCALAR;
+    }
+
+
+    const char* kernelName()
+    {
+        switch (kernel) {
+            case Kernel::AVX2:  return "avx2";
+            case Kernel::SSE41: return "sse4.1";
+            default:            return "scalar";
+        }
+    }
+
+
+    // Little endian values at any alignment
+    template<typename T>
+    static T read(const uint8_t*& data)
+    {
+        T value;
+        std::memcpy(&value, data, sizeof(T));
+        data += sizeof(T);
+        return value;
+    }
+
+    template<typename T>
+    static void read(const uint8_t*& data, T* values, const std::size_t count)
+    {
+        std::memcpy(values, data, count * sizeof(T));
+        data += count * sizeof(T);
+    }
+
+
+    bool Network::load(const std::string& filePath, std::string& error)
+    {
+        Mapping::File newFile;
+
+        if (!newFile.open(filePath)) {
+            error = "can't open " + filePath;
+            return false;
+        }
+
+        const uint8_t* data    = newFile.data;
+        const std::size_t size = newFile.size;
+
+        const auto reject = [&](const std::string& reason) {
+            newFile.close();
+            error = filePath + ": " + reason;
+            return false;
+        };
+
+        if (size < headerBytes)
+            return reject("file too small");
+
+        const uint32_t version         = read<uint32_t>(data);
+        const uint32_t hash            = read<uint32_t>(data);
+        const uint32_t descriptionSize = read<uint32_t>(data);
+        (void)hash;
+
+        if (version != fileVersion)
+            return reject("unsupported version");
+
+        // Fixed architecture, so the size tells whether the layers match
+        if (size != headerBytes + descriptionSize + transformerBytes + networkBytes)
+            return reject("not a HalfKP 256x2-32-32 network");
+
+        data += descriptionSize;
+
+
+        // Nothing can fail from here on, replace the old network
+        unload();
+
+        file = newFile;
+
+        read<uint32_t>(data); // Transformer hash
+        read(data, transformerBiases, halfDimensions);
+
+        transformerWeights = data;
+        data += s_cast(std::size_t, inputDimensions) * rowBytes;
+
+        read<uint32_t>(data); // Network hash
+        read(data, l1Biases, l1Dimensions);
+        read(data, l1Weights, l1Dimensions * 2 * halfDimensions);
+        read(data, l2Biases, l2Dimensions);
+        read(data, l2Weights, l2Dimensions * l1Dimensions);
+        read(data, &outputBias, 1);
+        read(data, outputWeights, l2Dimensions);
+
+        path   = filePath;
+        loaded = true;
+
+        return true;
+    }
+
+
+    void Network::unload()
+    {
+        file.close();
+
+        transformerWeights = nullptr;
+        path               = "";
+        loaded             = false;
+    }
+
+
+    /*
+        Kernels
+
+        values:    dst = src + added rows - removed rows, 256 int16 (rows unaligned)
+        transform: both accumulators clipped to [0, 127], side to move first
+        affine:    output = biases + weights * input, uint8 input times int8 weights
+    */
+
+#ifdef NNUE_HAS_X86
+
+    __attribute__((target("avx2")))
+    static void updateValuesAVX2(int16_t* dst, const int16_t* src, const uint8_t* const* added, const int addedCount, const uint8_t* const* removed, const int removedCount)
+    {
+        for (int i = 0; i < halfDimensions; i += 16) {
+            __m256i sum = _mm256_load_si256(reinterpret_cast<const __m256i*>(src + i));
+
+            for (int j = 0; j < addedCount; ++j)
+                sum = _mm256_add_epi16(sum, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(added[j] + i * 2)));
+
+            for (int j = 0; j < removedCount; ++j)
+                sum = _mm256_sub_epi16(sum, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(removed[j] + i * 2)));
+
+            _mm256_store_si256(reinterpret_cast<__m256i*>(dst + i), sum);
+        }
+    }
+
+
+    __attribute__((target("sse4.1")))
+    static void updateValuesSSE41(int16_t* dst, const int16_t* src, const uint8_t* const* added, const int addedCount, const uint8_t* const* removed, const int removedCount)
+    {
+        for (int i = 0; i < halfDimensions; i += 8) {
+            __m128i sum = _mm_load_si128(reinterpret_cast<const __m128i*>(src + i));
+
+            for (int j = 0; j < addedCount; ++j)
+                sum = _mm_add_epi16(sum, _mm_loadu_si128(reinterpret_cast<const __m128i*>(added[j] + i * 2)));
+
+            for (int j = 0; j < removedCount; ++j)
+                sum = _mm_sub_epi16(sum, _mm_loadu_si128(reinterpret_cast<const __m128i*>(removed[j] + i * 2)));
+
+            _mm_store_si128(reinterpret_cast<__m128i*>(dst + i), sum);
+        }
+    }
+
+
+    __attribute__((target("avx2")))
+    static void transformAVX2(const int16_t* values, uint8_t* output)
+    {
+        const __m256i zero = _mm256_setzero_si256();
+
+        for (int i = 0; i < halfDimensions; i += 32) {
+            const __m256i low  = _mm256_load_si256(reinterpret_cast<const __m256i*>(values + i));
+            const __m256i high = _mm256_load_si256(reinterpret_cast<const __m256i*>(values + i + 16));
+
+            // Packing works per 128-bit lane, the permute puts the quarters back in order
+            const __m256i packed = _mm256_max_epi8(_mm256_packs_epi16(low, high), zero);
+            _mm256_store_si256(reinterpret_cast<__m256i*>(output + i), _mm256_permute4x64_epi64(packed, 0xD8));
+        }
+    }
+
+
+    __attribute__((target("sse4.1")))
+    static void transformSSE41(const int16_t* values, uint8_t* output)
+    {
+        const __m128i zero = _mm_setzero_si128();
+
+        for (int i = 0; i < halfDimensions; i += 16) {
+            const __m128i low  = _mm_load_si128(reinterpret_cast<const __m128i*>(values + i));
+            const __m128i high = _mm_load_si128(reinterpret_cast<const __m128i*>(values + i + 8));
+
+            _mm_store_si128(reinterpret_cast<__m128i*>(output + i), _mm_max_epi8(_mm_packs_epi16(low, high), zero));
+        }
+    }
+
+
+    // Inputs are at most 127, so the pairwise sums of maddubs can't saturate
+    __attribute__((target("avx2")))
+    static void affineAVX2(const uint8_t* input, const int inputDimensions, const int8_t* weights, const int32_t* biases, const int outputDimensions, int32_t* output)
+    {
+        const __m256i ones = _mm256_set1_epi16(1);
+
+        for (int o = 0; o < outputDimensions; ++o) {
+            const int8_t* row = weights + o * inputDimensions;
+            __m256i sum       = _mm256_setzero_si256();
+
+            for (int i = 0; i < inputDimensions; i += 32) {
+                const __m256i products = _mm256_maddubs_epi16(_mm256_load_si256(reinterpret_cast<const __m256i*>(input + i)),
+                                                              _mm256_load_si256(reinterpret_cast<const __m256i*>(row + i)));
+                sum = _mm256_add_epi32(sum, _mm256_madd_epi16(products, ones));
+            }
+
+            __m128i total = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+            total         = _mm_add_epi32(total, _mm_shuffle_epi32(total, 0x4E));
+            total         = _mm_add_epi32(total, _mm_shuffle_epi32(total, 0xB1));
+
+            output[o] = biases[o] + _mm_cvtsi128_si32(total);
+        }
+    }
+
+
+    __attribute__((target("sse4.1")))
+    static void affineSSE41(const uint8_t* input, const int inputDimensions, const int8_t* weights, const int32_t* biases, const int outputDimensions, int32_t* output)
+    {
+        const __m128i ones = _mm_set1_epi16(1);
+
+        for (int o = 0; o < outputDimensions; ++o) {
+            const int8_t* row = weights + o * inputDimensions;
+            __m128i sum       = _mm_setzero_si128();
+
+            for (int i = 0; i < inputDimensions; i += 16) {
+                const __m128i products = _mm_maddubs_epi16(_mm_load_si128(reinterpret_cast<const __m128i*>(input + i)),
+                                                           _mm_load_si128(reinterpret_cast<const __m128i*>(row + i)));
+                sum = _mm_add_epi32(sum, _mm_madd_epi16(products, ones));
+            }
+
+            sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+            sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+
+            output[o] = biases[o] + _mm_cvtsi128_si32(sum);
+        }
+    }
+
+#endif
+
+
+    static void updateValuesScalar(int16_t* dst, const int16_t* src, const uint8_t* const* added, const int addedCount, const uint8_t* const* removed, const int removedCount)
+    {
+        int16_t sums[halfDimensions];
+        std::copy(src, src + halfDimensions, sums);
+
+        int16_t row[halfDimensions];
+
+        for (int j = 0; j < addedCount; ++j) {
+            std::memcpy(row, added[j], rowBytes);
+            for (int i = 0; i < halfDimensions; ++i)
+                sums[i] = s_cast(int16_t, sums[i] + row[i]);
+        }
+
+        for (int j = 0; j < removedCount; ++j) {
+            std::memcpy(row, removed[j], rowBytes);
+            for (int i = 0; i < halfDimensions; ++i)
+                sums[i] = s_cast(int16_t, sums[i] - row[i]);
+        }
+
+        std::copy(sums, sums + halfDimensions, dst);
+    }
+
+
+    static void transformScalar(const int16_t* values, uint8_t* output)
+    {
+        for (int i = 0; i < halfDimensions; ++i)
+            output[i] = s_cast(uint8_t, std::clamp<int>(values[i], 0, 127));
+    }
+
+
+    static void affineScalar(const uint8_t* input, const int inputDimensions, const int8_t* weights, const int32_t* biases, const int outputDimensions, int32_t* output)
+    {
+        for (int o = 0; o < outputDimensions; ++o) {
+            const int8_t* row = weights + o * inputDimensions;
+            int32_t sum       = biases[o];
+
+            for (int i = 0; i < inputDimensions; ++i)
+                sum += input[i] * row[i];
+
+            output[o] = sum;
+        }
+    }
+
+
+    static void updateValues(int16_t* dst, const int16_t* src, const uint8_t* const* added, const int addedCount, const uint8_t* const* removed, const int removedCount)
+    {
+#ifdef NNUE_HAS_X86
+        if (kernel == Kernel::AVX2)
+            return updateValuesAVX2(dst, src, added, addedCount, removed, removedCount);
+        if (kernel == Kernel::SSE41)
+            return updateValuesSSE41(dst, src, added, addedCount, removed, removedCount);
+#endif
+        updateValuesScalar(dst, src, added, addedCount, removed, removedCount);
+    }
+
+
+    static void transform(const int16_t* values, uint8_t* output)
+    {
+#ifdef NNUE_HAS_X86
+        if (kernel == Kernel::AVX2)
+            return transformAVX2(values, output);
+        if (kernel == Kernel::SSE41)
+            return transformSSE41(values, output);
+#endif
+        transformScalar(values, output);
+    }
+
+
+    static void affine(const uint8_t* input, const int inputDimensions, const int8_t* weights, const int32_t* biases, const int outputDimensions, int32_t* output)
+    {
+#ifdef NNUE_HAS_X86
+        if (kernel == Kernel::AVX2)
+            return affineAVX2(input, inputDimensions, weights, biases, outputDimensions, output);
+        if (kernel == Kernel::SSE41)
+            return affineSSE41(input, inputDimensions, weights, biases, outputDimensions, output);
+#endif
+        affineScalar(input, inputDimensions, weights, biases, outputDimensions, output);
+    }
+
+
+    static void clippedReLU(const int32_t* input, const int dimensions, uint8_t* output)
+    {
+        for (int i = 0; i < dimensions; ++i)
+            output[i] = s_cast(uint8_t, std::clamp(input[i] >> weightScaleBits, 0, 127));
+    }
+
+
+    /*
+        Accumulators
+    */
+
+    // Transformer row of a piece seen from one side, Black sees the board rotated
+    [[nodiscard]] static const uint8_t* featureRow(const bool perspective, const Square kingSquare, const int piece, const Square square)
+    {
+        const int orient = perspective ? 0 : 63;
+        const bool isOwn = Utils::isPieceWhite(piece) == perspective;
+
+        const int index = (square ^ orient) + 1 + 128 * (piece >> 1) + 64 * !isOwn + 641 * (kingSquare ^ orient);
+
+        return network.transformerWeights + s_cast(std::size_t, index) * rowBytes;
+    }
+
+
+    static void refresh(const Board& board, Accumulator& accumulator, const bool perspective)
+    {
+        const Bitboard kings    = board.bitboards[Pieces::Piece::W_KING] | board.bitboards[Pieces::Piece::B_KING];
+        const Square kingSquare = std::countr_zero(board.bitboards[perspective ? Pieces::Piece::W_KING : Pieces::Piece::B_KING]);
+
+        const uint8_t* rows[32];
+        int count = 0;
+
+        Bitboard pieces = (board.occupiedSquares[0] | board.occupiedSquares[1]) & ~kings;
+
+        while (pieces) {
+            const Square square = s_cast(Square, std::countr_zero(pieces));
+            pieces &= pieces - 1;
+
+            rows[count++] = featureRow(perspective, kingSquare, board.mailbox[square], square);
+        }
+
+        updateValues(accumulator.values[perspective], network.transformerBiases, rows, count, nullptr, 0);
+        accumulator.computed[perspective] = true;
+    }
+
+
+    [[nodiscard]] static bool movesPiece(const DirtyPieces& dirty, const int piece)
+    {
+        for (int i = 0; i < dirty.count; ++i) {
+            if (dirty.piece[i] == piece)
+                return true;
+        }
+
+        return false;
+    }
+
+
+    static void update(const Board& board, Accumulator* stack, const int index, const bool perspective)
+    {
+        const int king = perspective ? Pieces::Piece::W_KING : Pieces::Piece::B_KING;
+
+        // Walk back to the last computed accumulator, a move of our own king changes every feature
+        int last = index;
+
+        while (!stack[last].computed[perspective]) {
+            if (last == 0 || movesPiece(stack[last].dirty, king)) {
+                refresh(board, stack[index], perspective);
+                return;
+            }
+
+            --last;
+        }
+
+        const Square kingSquare = std::countr_zero(board.bitboards[king]);
+
+        for (int i = last + 1; i <= index; ++i) {
+            const DirtyPieces& dirty = stack[i].dirty;
+
+            const uint8_t* added[3];
+            const uint8_t* removed[3];
+            int addedCount   = 0;
+            int removedCount = 0;
+
+            for (int j = 0; j < dirty.count; ++j) {
+                // Kings are not features, only the square of our own one is
+                if ((dirty.piece[j] >> 1) == Pieces::PieceType::KING)
+                    continue;
+
+                if (dirty.from[j] != 64)
+                    removed[removedCount++] = featureRow(perspective, kingSquare, dirty.piece[j], dirty.from[j]);
+                if (dirty.to[j] != 64)
+                    added[addedCount++] = featureRow(perspective, kingSquare, dirty.piece[j], dirty.to[j]);
+            }
+
+            updateValues(stack[i].values[perspective], stack[i - 1].values[perspective], added, addedCount, removed, removedCount);
+            stack[i].computed[perspective] = true;
+        }
+    }
+
+
+    int evaluate(const Board& board, Accumulator* stack, const int index, const bool isWhiteTurn)
+    {
+        update(board, stack, index, true);
+        update(board, stack, index, false);
+
+        alignas(32) uint8_t transformed[2 * halfDimensions];
+        alignas(32) int32_t l1Sums[l1Dimensions];
+        alignas(32) uint8_t l1Output[l1Dimensions];
+        alignas(32) int32_t l2Sums[l2Dimensions];
+        alignas(32) uint8_t l2Output[l2Dimensions];
+        int32_t output;
+
+        transform(stack[index].values[isWhiteTurn], transformed);
+        transform(stack[index].values[!isWhiteTurn], transformed + halfDimensions);
+
+        affine(transformed, 2 * halfDimensions, network.l1Weights, network.l1Biases, l1Dimensions, l1Sums);
+        clippedReLU(l1Sums, l1Dimensions, l1Output);
+
+        affine(l1Output, l1Dimensions, network.l2Weights, network.l2Biases, l2Dimensions, l2Sums);
+        clippedReLU(l2Sums, l2Dimensions, l2Output);
+
+        affine(l2Output, l2Dimensions, network.outputWeights, &network.outputBias, 1, &output);
+
+        // Keep clear of the mate scores
+        const int bound = Settings::tbWinScore - Settings::maxPly - 1;
+        return std::clamp(output / outputScale, -bound, bound);
+    }
+
+}
@@ -0,0 +1,138 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+    #define NNUE_HAS_X86
+#endif
+
+#include "utils.hpp"
+#include "pieces.hpp"
+#include "mapping.hpp"
+
+
+struct Board;
+
+
+namespace NNUE
+{
+
+    /*
+        Efficiently updatable neural network (HalfKP 41024->256x2-32-32-1)
+
+        Reads the original Stockfish 12 .nnue format. The input features
+        are (own king square, piece, square) for every piece except the
+        kings, seen from both sides, which makes the first layer sparse:
+        a move only touches a handful of its 41024 rows. Its outputs for
+        each side (the accumulators) are kept per ply and brought up to
+        date lazily from the pieces each move changed. Only a move of a
+        side's own king forces that side's accumulator to be rebuilt.
+
+            file layout (little endian)
+
+                header          version, hash, description
+                transformer     hash, int16 biases[256], int16 weights[41024][256]
+                network         hash, then per layer int32 biases[out], int8 weights[out][in]
+
+        The transformer weights (about 20 MB) are used straight from the
+        memory mapped file, everything else is copied out at load time.
+    */
+
+    constexpr uint32_t fileVersion = 0x7AF32F16;
+
+    constexpr int inputDimensions = 64 * 641;
+    constexpr int halfDimensions  = 256;
+    constexpr int l1Dimensions    = 32;
+    constexpr int l2Dimensions    = 32;
+
+    // Network output per centipawn
+    constexpr int outputScale = 16;
+
+    // Fixed point shift between the hidden layers
+    constexpr int weightScaleBits = 6;
+
+
+    /*
+        SIMD kernels
+
+        AVX2:   256-bit integer ops
+        SSE41:  128-bit integer ops
+        SCALAR: plain loops, runs everywhere
+
+        Picked at startup from CPUID, the x86 kernels are compiled with
+        per-function target attributes so the build itself stays generic.
+    */
+
+    enum class Kernel
+    {
+        SCALAR,
+        SSE41,
+        AVX2
+    };
+
+    inline Kernel kernel = Kernel::SCALAR;
+
+    [[nodiscard]] Kernel detectKernel();
+    [[nodiscard]] const char* kernelName();
+
+
+    struct Network
+    {
+        bool loaded      = false;
+        std::string path = "";
+
+        Mapping::File file;
+
+        const uint8_t* transformerWeights = nullptr; // int16, not aligned
+
+        alignas(32) int16_t transformerBiases[halfDimensions] = {};
+
+        alignas(32) int32_t l1Biases[l1Dimensions]                       = {};
+        alignas(32) int8_t l1Weights[l1Dimensions * 2 * halfDimensions] = {};
+        alignas(32) int32_t l2Biases[l2Dimensions]                       = {};
+        alignas(32) int8_t l2Weights[l2Dimensions * l1Dimensions]        = {};
+        alignas(32) int32_t outputBias                                   = 0;
+        alignas(32) int8_t outputWeights[l2Dimensions]                   = {};
+
+        // False with a reason in error if the file can't be used, the old network is kept then
+        bool load(const std::string& filePath, std::string& error);
+        void unload();
+    };
+
+    inline Network network;
+
+
+    // Pieces a move put on or took off the board, 64 for off the board
+    struct DirtyPieces
+    {
+        int count = 0;
+
+        int piece[3]     = {};
+        Square from[3]   = {};
+        Square to[3]     = {};
+
+        inline void add(const int movedPiece, const Square fromSquare, const Square toSquare)
+        {
+            piece[count] = movedPiece;
+            from[count]  = fromSquare;
+            to[count]    = toSquare;
+            ++count;
+        }
+    };
+
+
+    // First layer output for both sides, indexed like Board::occupiedSquares (0: Black, 1: White)
+    struct Accumulator
+    {
+        alignas(32) int16_t values[2][halfDimensions];
+        bool computed[2] = {false, false};
+
+        // What changed since the accumulator below it on the stack
+        DirtyPieces dirty;
+    };
+
+
+    // stack[index] is the current position, entries below it are the positions before it
+    [[nodiscard]] int evaluate(const Board& board, Accumulator* stack, const int index, const bool isWhiteTurn);
+
+}
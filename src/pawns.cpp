@@ -0,0 +1,177 @@
+#include <algorithm>
+#include <bit>
+
+#include "pawns.hpp"
+#include "board.hpp"
+
+
+namespace Pawns
+{
+
+    // Pawn terms by rank from the pawn's own side, in centipawns
+    constexpr int passedMg[8] = {0, 5, 10, 15, 25, 40, 60, 0};
+    constexpr int passedEg[8] = {0, 10, 20, 35, 60, 100, 150, 0};
+
+    constexpr int isolatedMg = -10;
+    constexpr int isolatedEg = -15;
+    constexpr int doubledMg  = -10;
+    constexpr int doubledEg  = -25;
+    constexpr int backwardMg = -8;
+    constexpr int backwardEg = -10;
+
+    constexpr int blockedPasserEg = -20;
+
+    // By how far the closest pawn on a file stands in front of the king
+    constexpr int shieldBonus[3] = {-20, 15, 8}; // No pawn, one rank, two ranks
+
+
+    struct Masks
+    {
+        Bitboard files[8]         = {};
+        Bitboard adjacentFiles[8] = {};
+
+        // Every rank in front of the given one, [color][rank]
+        Bitboard forwardRanks[2][8] = {};
+
+        // Squares an enemy pawn would have to be on to stop a pawn from passing, [color][square]
+        Bitboard passedSpan[2][64] = {};
+    };
+
+    constexpr Masks masks = [] {
+        Masks m;
+
+        for (int file = 0; file < 8; ++file)
+            m.files[file] = 0x0101010101010101ULL << file;
+
+        for (int file = 0; file < 8; ++file)
+            m.adjacentFiles[file] = (file > 0 ? m.files[file - 1] : 0ULL) | (file < 7 ? m.files[file + 1] : 0ULL);
+
+        for (int rank = 0; rank < 8; ++rank) {
+            m.forwardRanks[1][rank] = (rank < 7) ? (~0ULL << (8 * (rank + 1))) : 0ULL;
+            m.forwardRanks[0][rank] = (rank > 0) ? (~0ULL >> (8 * (8 - rank))) : 0ULL;
+        }
+
+        for (int color = 0; color < 2; ++color) {
+            for (int square = 0; square < 64; ++square) {
+                const int file = square & 7;
+                m.passedSpan[color][square] = m.forwardRanks[color][square >> 3] & (m.files[file] | m.adjacentFiles[file]);
+            }
+        }
+
+        return m;
+    }();
+
+
+    void Table::clear()
+    {
+        std::fill(entries.get(), entries.get() + Settings::pawnHashEntries, Entry{});
+    }
+
+
+    void evaluate(const Board& board, Entry& entry)
+    {
+        entry.key = board.pawnKey;
+        entry.mg  = 0;
+        entry.eg  = 0;
+
+        entry.kingSquare[0] = entry.kingSquare[1] = 64;
+
+        for (int color = 0; color < 2; ++color) {
+            const int sign = color ? 1 : -1;
+
+            const Bitboard own   = board.bitboards[color ? Pieces::Piece::W_PAWN : Pieces::Piece::B_PAWN];
+            const Bitboard enemy = board.bitboards[color ? Pieces::Piece::B_PAWN : Pieces::Piece::W_PAWN];
+
+            entry.passed[color] = 0ULL;
+
+            Bitboard pawns = own;
+
+            while (pawns) {
+                const Square square = s_cast(Square, std::countr_zero(pawns));
+                pawns &= pawns - 1;
+
+                const int file         = square & 7;
+                const int rank         = square >> 3;
+                const int relativeRank = color ? rank : 7 - rank;
+
+                const Bitboard ahead = masks.forwardRanks[color][rank] & masks.files[file];
+
+                // Only the front pawn of a doubled pair can be passed
+                if (!(enemy & masks.passedSpan[color][square]) && !(own & ahead)) {
+                    entry.passed[color] |= 1ULL << square;
+                    entry.mg += sign * passedMg[relativeRank];
+                    entry.eg += sign * passedEg[relativeRank];
+                }
+
+                if (own & ahead) {
+                    entry.mg += sign * doubledMg;
+                    entry.eg += sign * doubledEg;
+                }
+
+                if (!(own & masks.adjacentFiles[file])) {
+                    entry.mg += sign * isolatedMg;
+                    entry.eg += sign * isolatedEg;
+                    continue;
+                }
+
+                // No neighbour level or behind to support it, and the square in front is covered by an enemy pawn
+                const Bitboard supporters = own & masks.adjacentFiles[file] & ~masks.forwardRanks[color][rank];
+                const Square stopSquare   = color ? square + 8 : square - 8;
+
+                if (!supporters && (board.precomputedMoves.pawnAttacks[color][stopSquare] & enemy)) {
+                    entry.mg += sign * backwardMg;
+                    entry.eg += sign * backwardEg;
+                }
+            }
+        }
+    }
+
+
+    int kingShield(const Board& board, Entry& entry, const bool color)
+    {
+        const Square kingSquare = std::countr_zero(board.bitboards[color ? Pieces::Piece::W_KING : Pieces::Piece::B_KING]);
+
+        if (entry.kingSquare[color] == kingSquare)
+            return entry.shield[color];
+
+        const Bitboard own = board.bitboards[color ? Pieces::Piece::W_PAWN : Pieces::Piece::B_PAWN];
+
+        const int kingRank   = kingSquare >> 3;
+        const int centerFile = std::clamp(kingSquare & 7, 1, 6);
+
+        int score = 0;
+
+        for (int file = centerFile - 1; file <= centerFile + 1; ++file) {
+            const Bitboard shield = own & masks.files[file] & masks.forwardRanks[color][kingRank];
+
+            if (!shield) {
+                score += shieldBonus[0];
+                continue;
+            }
+
+            // Closest pawn in front of the king
+            const Square closest = color ? std::countr_zero(shield) : 63 - std::countl_zero(shield);
+            const int distance   = std::abs((closest >> 3) - kingRank);
+
+            if (distance <= 2)
+                score += shieldBonus[distance];
+        }
+
+        entry.kingSquare[color] = kingSquare;
+        entry.shield[color]     = score;
+
+        return score;
+    }
+
+
+    int blockedPassers(const Board& board, const Entry& entry)
+    {
+        const Bitboard occupied = board.occupiedSquares[0] | board.occupiedSquares[1];
+
+        const int white = std::popcount((entry.passed[1] << 8) & occupied);
+        const int black = std::popcount((entry.passed[0] >> 8) & occupied);
+
+        return (white - black) * blockedPasserEg;
+    }
+
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+
+#include "utils.hpp"
+#include "pieces.hpp"
+#include "settings.hpp"
+
+
+struct Board;
+
+
+namespace Pawns
+{
+
+    /*
+        Pawn structure evaluation and cache
+
+        Passed, isolated, doubled and backward pawns only depend on where
+        the pawns are, so they are cached under the board's pawn key, a
+        Zobrist key over pawns alone. The king shield also depends on the
+        king square, it is cached per side together with the square it was
+        computed for and redone when the king has moved.
+
+        Every search thread has its own table, entries are overwritten
+        without checks for depth or age.
+    */
+
+    struct Entry
+    {
+        uint64_t key = 0ULL;
+
+        int mg = 0; // From White's point of view, shield not included
+        int eg = 0;
+
+        // Indexed like Board::occupiedSquares (0: Black, 1: White)
+        Bitboard passed[2]   = {0ULL, 0ULL};
+        int shield[2]        = {0, 0};
+        Square kingSquare[2] = {64, 64};
+    };
+
+
+    struct Table
+    {
+        std::unique_ptr<Entry[]> entries = std::make_unique<Entry[]>(Settings::pawnHashEntries);
+
+        [[nodiscard]] inline Entry& operator[](const uint64_t key)
+        {
+            return entries[key & (Settings::pawnHashEntries - 1)];
+        }
+
+        void clear();
+    };
+
+
+    // Fills in the pawn terms and passed pawns, leaves the shields for kingShield()
+    void evaluate(const Board& board, Entry& entry);
+
+    // Middlegame bonus for pawns in front of the king, cached in the entry
+    [[nodiscard]] int kingShield(const Board& board, Entry& entry, const bool color);
+
+    // Endgame penalty for passed pawns with a piece in front of them, from White's point of view
+    [[nodiscard]] int blockedPassers(const Board& board, const Entry& entry);
+
+}
@@ -48,10 +48,13 @@ namespace Pieces
     };
 
 
-    enum class MoveFlag
+    // Stored in the top 4 bits of a Move, promotions decode with (flag - 4) / 2 + KNIGHT
+    enum class MoveFlag : uint8_t
     {
         NONE             = 0,
+        DOUBLE_PUSH      = 1,
         CASTLING         = 2,
+        EN_PASSANT       = 3,
         PROMOTION_KNIGHT = 4,
         PROMOTION_BISHOP = 6,
         PROMOTION_ROOK   = 8,
@@ -59,19 +62,56 @@ namespace Pieces
     };
 
 
+    /*
+        Move layout (16 bits)
+
+            from   6   bits 0-5
+            to     6   bits 6-11
+            flag   4   bits 12-15
+
+        All zeros (a1a1) is the null move. The same 16 bits are stored in
+        the transposition table.
+    */
+
     struct Move
     {
-        uint8_t fromSquare     = 64;
-        uint8_t toSquare       = 64;
-        int promotionPieceType = PieceType::PIECE_TYPE_COUNT;
-        bool isCastle          = false;
-    };
+        uint16_t data = 0;
 
+        constexpr Move() = default;
 
-    struct ScoredMove
-    {
-        Move move = {};
-        int score = 0;
+        constexpr Move(const int fromSquare, const int toSquare, const MoveFlag flag = MoveFlag::NONE)
+            : data(static_cast<uint16_t>(fromSquare | (toSquare << 6) | (static_cast<int>(flag) << 12)))
+        {}
+
+        [[nodiscard]] static constexpr Move fromData(const uint16_t data)
+        {
+            Move move;
+            move.data = data;
+            return move;
+        }
+
+        [[nodiscard]] constexpr uint8_t from() const { return data & 63; }
+        [[nodiscard]] constexpr uint8_t to() const { return (data >> 6) & 63; }
+        [[nodiscard]] constexpr MoveFlag flag() const { return static_cast<MoveFlag>(data >> 12); }
+
+        [[nodiscard]] constexpr bool isNull() const { return data == 0; }
+        [[nodiscard]] constexpr bool isCastle() const { return flag() == MoveFlag::CASTLING; }
+        [[nodiscard]] constexpr bool isEnPassant() const { return flag() == MoveFlag::EN_PASSANT; }
+        [[nodiscard]] constexpr bool isDoublePush() const { return flag() == MoveFlag::DOUBLE_PUSH; }
+        [[nodiscard]] constexpr bool isPromotion() const { return flag() >= MoveFlag::PROMOTION_KNIGHT; }
+
+        // PIECE_TYPE_COUNT if not a promotion
+        [[nodiscard]] constexpr int promotionPieceType() const
+        {
+            return isPromotion() ? PieceType::KNIGHT + (static_cast<int>(flag()) - 4) / 2 : PieceType::PIECE_TYPE_COUNT;
+        }
+
+        [[nodiscard]] static constexpr MoveFlag promotionFlag(const int pieceType)
+        {
+            return static_cast<MoveFlag>(4 + 2 * (pieceType - PieceType::KNIGHT));
+        }
+
+        bool operator==(const Move&) const = default;
     };
 
 
@@ -0,0 +1,176 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <cstdlib>
+#include <cmath>
+
+#include "settings.hpp"
+#include "pieces.hpp"
+#include "utils.hpp"
+
+
+namespace Search
+{
+
+    // Set by the UCI thread, polled by the search every few nodes
+    inline std::atomic<bool> stopSignal = false;
+    inline std::atomic<bool> ponder     = false; // Cleared by "ponderhit"
+
+    // Summed over all search threads, each adds its count every few nodes
+    inline std::atomic<uint64_t> totalNodes = 0;
+    inline std::atomic<uint64_t> tbHits     = 0; // Tablebase probes that found the position
+
+
+    // Search features, each can be switched off with a UCI option for testing
+    struct Options
+    {
+        bool pvs             = true;
+        bool aspiration      = true;
+        bool nullMove        = true;
+        bool lmr             = true;
+        bool reverseFutility = true;
+        bool futility        = true;
+    };
+
+    // Only changed between searches
+    inline Options options;
+
+
+    // Late move reductions by [depth][move number], filled by initReductions()
+    inline int reductions[64][64];
+
+    inline void initReductions()
+    {
+        for (int depth = 1; depth < 64; ++depth) {
+            for (int moveCount = 1; moveCount < 64; ++moveCount)
+                reductions[depth][moveCount] = s_cast(int, 0.75 + std::log(depth) * std::log(moveCount) / 2.25);
+        }
+    }
+
+
+    // Parsed from "go", zero means no limit
+    struct Limits
+    {
+        int depth        = Settings::maxPly - 1;
+        uint64_t nodes   = 0;
+        int64_t movetime = 0;
+        bool infinite    = false;
+
+        // Clock, indexed like Board::occupiedSquares (0: Black, 1: White)
+        int64_t time[2] = {0, 0};
+        int64_t inc[2]  = {0, 0};
+        int movesToGo   = 0;
+        bool hasClock   = false; // wtime or btime given, even if zero or for the opponent only
+    };
+
+
+    /*
+        Triangular PV table
+
+        Row [ply] holds the best line found from that ply on. A new best
+        move at ply is followed by a copy of the row below it.
+    */
+
+    struct PVTable
+    {
+        Pieces::Move moves[Settings::maxPly][Settings::maxPly] = {};
+        int length[Settings::maxPly]                          = {};
+
+        inline void clear(const int ply)
+        {
+            length[ply] = ply;
+        }
+
+        inline void update(const int ply, const Pieces::Move& move)
+        {
+            moves[ply][ply] = move;
+
+            for (int i = ply + 1; i < length[ply + 1]; ++i)
+                moves[ply][i] = moves[ply + 1][i];
+
+            length[ply] = length[ply + 1];
+        }
+    };
+
+
+    /*
+        Quiet move ordering
+
+        killers       two quiet moves per ply that caused a beta cutoff
+        history       butterfly table [color][from][to], rewarded when a
+                      quiet move cuts off and penalised for the quiets
+                      searched before it
+        counterMoves  the quiet move that refuted the opponent's last
+                      move, indexed by [piece][to] of that move
+
+        History uses gravity updates: every bonus is scaled down by the
+        current value, so entries saturate at +-maxHistory instead of
+        overflowing, and old results fade as new ones come in.
+
+        One table per search thread, kept between searches.
+    */
+
+    struct Heuristics
+    {
+        static constexpr int maxHistory = 16384;
+
+        Pieces::Move killers[Settings::maxPly][2]                 = {};
+        int history[2][64][64]                                    = {};
+        Pieces::Move counterMoves[Pieces::Piece::PIECE_COUNT][64] = {};
+
+        // Beta cutoff statistics for the current search
+        uint64_t cutoffs      = 0;
+        uint64_t quietCutoffs = 0;
+        uint64_t killerHits   = 0;
+        uint64_t counterHits  = 0;
+        uint64_t historyHits  = 0; // Cut off by the first quiet in history order
+
+        inline void clear()
+        {
+            *this = Heuristics{};
+        }
+
+        // Killers belong to the previous root position
+        inline void newSearch()
+        {
+            for (auto& plyKillers : killers)
+                plyKillers[0] = plyKillers[1] = Pieces::Move{};
+
+            cutoffs = quietCutoffs = killerHits = counterHits = historyHits = 0;
+        }
+
+        inline void updateHistory(const bool color, const Pieces::Move& move, const int bonus)
+        {
+            int& entry = history[color][move.from()][move.to()];
+            entry += bonus - entry * std::abs(bonus) / maxHistory;
+        }
+
+        inline void updateKillers(const int ply, const Pieces::Move& move)
+        {
+            if (killers[ply][0] != move) {
+                killers[ply][1] = killers[ply][0];
+                killers[ply][0] = move;
+            }
+        }
+
+        // Percentage of quiet cutoffs, for info output
+        [[nodiscard]] inline int hitRate(const uint64_t hits) const
+        {
+            return quietCutoffs ? s_cast(int, hits * 100 / quietCutoffs) : 0;
+        }
+    };
+
+
+    // "cp <x>" or "mate <moves>", negative when getting mated
+    [[nodiscard]] inline std::string scoreToUCI(const int score)
+    {
+        if (score >= Settings::mateScore - Settings::maxPly)
+            return "mate " + std::to_string((Settings::mateScore - score + 1) / 2);
+        if (score <= -Settings::mateScore + Settings::maxPly)
+            return "mate " + std::to_string(-(Settings::mateScore + score) / 2);
+
+        return "cp " + std::to_string(score);
+    }
+
+}
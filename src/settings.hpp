@@ -2,5 +2,38 @@
 
 namespace Settings
 {
-    constexpr int maxPlyDepth = 4;
+    // Depth for a bare "go" with no limits
+    constexpr int defaultDepth = 4;
+
+    // Scores
+    constexpr int mateScore = 32000;
+    constexpr int infinity  = 32001;
+    constexpr int maxPly    = 128;
+
+    // Tablebase wins, below every mate score and above every evaluation
+    constexpr int tbWinScore = mateScore - 2 * maxPly;
+
+    // Pruning, margins in centipawns
+    constexpr int aspirationWindow      = 25;
+    constexpr int nullMoveMinDepth      = 3;
+    constexpr int reverseFutilityDepth  = 6;
+    constexpr int reverseFutilityMargin = 80; // Per ply
+    constexpr int futilityDepth         = 3;
+    constexpr int futilityMargin        = 120; // Per ply
+
+    // Quiescence skips captures that can't bring the score back up to alpha even with this much to spare
+    constexpr int deltaMargin = 200;
+
+    // Transposition table size in MB
+    constexpr int defaultHashSize = 16;
+    constexpr int maxHashSize     = 65536;
+
+    constexpr int maxThreads = 1024;
+
+    // Pawn hash entries per search thread, a power of two
+    constexpr int pawnHashEntries = 16384;
+
+    // Time kept back per move for GUI and network lag, in ms
+    constexpr int defaultMoveOverhead = 10;
+    constexpr int maxMoveOverhead     = 5000;
 }
@@ -0,0 +1,1271 @@
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+#include "syzygy.hpp"
+#include "mapping.hpp"
+
+
+namespace Syzygy
+{
+
+    constexpr int maxPieces = 7;
+    constexpr int maxDTZ    = 1 << 18; // Above any DTZ, root move ranks are built around it
+
+    // Table piece codes: White pawn to king 1..6, Black 9..14
+    [[nodiscard]] static int tablePiece(const int piece)
+    {
+        return (piece >> 1) + 1 + 8 * (piece & 1);
+    }
+
+
+    [[nodiscard]] static uint32_t readLE16(const uint8_t* data) { return data[0] | (data[1] << 8); }
+    [[nodiscard]] static uint32_t readLE32(const uint8_t* data) { return readLE16(data) | (readLE16(data + 2) << 16); }
+    [[nodiscard]] static uint32_t readBE32(const uint8_t* data) { return (data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3]; }
+    [[nodiscard]] static uint64_t readBE64(const uint8_t* data) { return (s_cast(uint64_t, readBE32(data)) << 32) | readBE32(data + 4); }
+
+
+    /*
+        Index tables
+
+        A position is turned into an index by mirroring it so the leading
+        piece (or pawn) lands in a fixed corner of the board and encoding
+        each group of like pieces as a combination of free squares.
+    */
+
+    // Rank minus file, 0 on the a1-h8 diagonal and negative below it
+    [[nodiscard]] constexpr int offDiagonal(const int square)
+    {
+        return (square >> 3) - (square & 7);
+    }
+
+    struct Indexing
+    {
+        int mapB1H1H7[64] = {}; // Squares below the a1-h8 diagonal to 0..27
+        int mapA1D1D4[64] = {}; // The a1-d1-d4 triangle to 0..9, diagonal last
+        int mapKK[10][64] = {}; // The 462 king pairs with the first king in the triangle
+        int mapPawns[64]  = {}; // a2-h7 to 47..0, highest is nearest the edge and lowest rank
+
+        int binomial[6][64]     = {}; // k out of n
+        int leadPawnIdx[6][64]  = {}; // [leading pawns][square of the first]
+        int leadPawnsSize[6][4] = {}; // [leading pawns][file a..d]
+    };
+
+    constexpr Indexing indexing = [] {
+        Indexing t;
+
+        int code = 0;
+        for (int square = 0; square < 64; ++square) {
+            if (offDiagonal(square) < 0)
+                t.mapB1H1H7[square] = code++;
+        }
+
+        int diagonal[4]   = {};
+        int diagonalCount = 0;
+
+        code = 0;
+        for (int square = 0; square <= 27; ++square) {
+            if (offDiagonal(square) < 0 && (square & 7) <= 3)
+                t.mapA1D1D4[square] = code++;
+            else if (!offDiagonal(square) && (square & 7) <= 3)
+                diagonal[diagonalCount++] = square;
+        }
+
+        for (int i = 0; i < diagonalCount; ++i)
+            t.mapA1D1D4[diagonal[i]] = code++;
+
+
+        // Kings may not touch, with the first king on the diagonal the second may not be above it
+        int bothOnDiagonal[64][2] = {};
+        int bothCount             = 0;
+
+        code = 0;
+        for (int idx = 0; idx < 10; ++idx) {
+            for (int first = 0; first <= 27; ++first) {
+                // b1 is the only square mapped to 0 on purpose
+                if (t.mapA1D1D4[first] != idx || (!idx && first != 1))
+                    continue;
+
+                for (int second = 0; second < 64; ++second) {
+                    const int fileDistance = (first & 7) - (second & 7);
+                    const int rankDistance = (first >> 3) - (second >> 3);
+
+                    if (fileDistance >= -1 && fileDistance <= 1 && rankDistance >= -1 && rankDistance <= 1)
+                        continue;
+
+                    if (!offDiagonal(first) && offDiagonal(second) > 0)
+                        continue;
+
+                    if (!offDiagonal(first) && !offDiagonal(second)) {
+                        bothOnDiagonal[bothCount][0]   = idx;
+                        bothOnDiagonal[bothCount++][1] = second;
+                    }
+                    else {
+                        t.mapKK[idx][second] = code++;
+                    }
+                }
+            }
+        }
+
+        for (int i = 0; i < bothCount; ++i)
+            t.mapKK[bothOnDiagonal[i][0]][bothOnDiagonal[i][1]] = code++;
+
+
+        t.binomial[0][0] = 1;
+
+        for (int n = 1; n < 64; ++n) {
+            for (int k = 0; k < 6 && k <= n; ++k)
+                t.binomial[k][n] = (k > 0 ? t.binomial[k - 1][n - 1] : 0) + (k < n ? t.binomial[k][n - 1] : 0);
+        }
+
+
+        // Up to 5 leading pawns, the index restarts on every file since tables are split by file
+        int availableSquares = 47;
+
+        for (int leadPawns = 1; leadPawns <= 5; ++leadPawns) {
+            for (int file = 0; file < 4; ++file) {
+                int idx = 0;
+
+                for (int rank = 1; rank <= 6; ++rank) {
+                    const int square = rank * 8 + file;
+
+                    if (leadPawns == 1) {
+                        t.mapPawns[square]     = availableSquares--;
+                        t.mapPawns[square ^ 7] = availableSquares--;
+                    }
+
+                    t.leadPawnIdx[leadPawns][square] = idx;
+                    idx += t.binomial[leadPawns - 1][t.mapPawns[square]];
+                }
+
+                t.leadPawnsSize[leadPawns][file] = idx;
+            }
+        }
+
+        return t;
+    }();
+
+
+    /*
+        Tables
+
+        Values are compressed with Recursive Pairing (symbols standing for
+        pairs of symbols) and a canonical Huffman code over the symbols,
+        in blocks of up to 65536 values. A sparse index of block numbers
+        every "span" values and the per-block value counts locate the block
+        of an index without decoding the ones before it.
+    */
+
+    enum Flags
+    {
+        STM          = 1,
+        MAPPED       = 2,
+        WIN_PLIES    = 4,
+        LOSS_PLIES   = 8,
+        WIDE         = 16,
+        SINGLE_VALUE = 128
+    };
+
+    enum class ProbeState
+    {
+        FAIL,
+        OK,
+        CHANGE_STM,       // DTZ table for the other side to move
+        ZEROING_BEST_MOVE // The best move is a capture or pawn move, the stored value can't be used
+    };
+
+
+    // Decoding data of one table for one side to move and one leading pawn file
+    struct PairsData
+    {
+        uint8_t flags     = 0;
+        uint8_t maxSymLen = 0;
+        uint8_t minSymLen = 0; // The value itself for single value tables
+
+        uint32_t numBlocks        = 0;
+        std::size_t blockSize     = 0;
+        std::size_t span          = 0;
+        uint32_t blockLengthSize  = 0;
+        std::size_t sparseIndexSize = 0;
+
+        const uint8_t* lowestSym   = nullptr; // uint16 per symbol length, lowest symbol of that length
+        const uint8_t* btree       = nullptr; // 3 bytes per symbol, its left and right 12-bit halves
+        const uint8_t* blockLength = nullptr; // uint16 per block, values in it minus one
+        const uint8_t* sparseIndex = nullptr; // 6 bytes per entry, uint32 block and uint16 offset
+        const uint8_t* data        = nullptr; // Start of the compressed blocks
+
+        std::vector<uint64_t> base64; // Lowest code of each length, left aligned in 64 bits
+        std::vector<uint8_t> symlen;  // Values a symbol stands for, minus one
+
+        int pieces[maxPieces]            = {}; // Piece order, defines the groups
+        uint64_t groupIdx[maxPieces + 1] = {}; // Index multiplier of each group, the last one is the table size
+        int groupLen[maxPieces + 1]      = {}; // Pieces per group, zero terminated
+
+        uint16_t mapIdx[4] = {}; // DTZ value maps for win, loss, cursed win, blessed loss
+
+        [[nodiscard]] int left(const int symbol) const
+        {
+            const uint8_t* lr = btree + 3 * symbol;
+            return ((lr[1] & 0xF) << 8) | lr[0];
+        }
+
+        [[nodiscard]] int right(const int symbol) const
+        {
+            const uint8_t* lr = btree + 3 * symbol;
+            return (lr[2] << 4) | (lr[1] >> 4);
+        }
+    };
+
+
+    enum class TableType
+    {
+        WDL,
+        DTZ
+    };
+
+    struct Table
+    {
+        TableType type = TableType::WDL;
+        std::string name; // File name without extension, like "KRvK"
+
+        // Material of the position with the first side of the name as White, and as Black
+        uint64_t key  = 0ULL;
+        uint64_t key2 = 0ULL;
+
+        int pieceCount       = 0;
+        bool hasPawns        = false;
+        bool hasUniquePieces = false;
+        int pawnCount[2]     = {0, 0}; // Leading color, other color
+
+        // Set once the file has been looked at, mapped or not
+        std::atomic<bool> ready = false;
+        Mapping::File file;
+
+        const uint8_t* dtzMap = nullptr;
+
+        PairsData items[2][4] = {}; // [side to move][leading pawn file], DTZ tables have one side
+
+        [[nodiscard]] PairsData& get(const int stm, const int file)
+        {
+            return items[type == TableType::WDL ? stm : 0][hasPawns ? file : 0];
+        }
+    };
+
+    struct TablePair
+    {
+        Table wdl;
+        Table dtz;
+    };
+
+
+    std::vector<std::string> directories;
+    std::deque<TablePair> tables;
+    std::unordered_map<uint64_t, TablePair*> tablesByKey;
+
+    std::mutex mappingMutex;
+
+
+    // Piece counts packed 4 bits each, White then Black, pawn to queen
+    [[nodiscard]] static uint64_t materialKey(const int (&counts)[2][5], const bool isMirrored)
+    {
+        uint64_t key = 0ULL;
+
+        for (int type = 0; type < 5; ++type) {
+            key |= s_cast(uint64_t, counts[!isMirrored][type]) << (4 * type);
+            key |= s_cast(uint64_t, counts[isMirrored][type]) << (4 * (type + 5));
+        }
+
+        return key;
+    }
+
+    [[nodiscard]] static uint64_t materialKey(const Board& board)
+    {
+        int counts[2][5];
+
+        for (int type = 0; type < 5; ++type) {
+            counts[1][type] = std::popcount(board.bitboards[type << 1]);
+            counts[0][type] = std::popcount(board.bitboards[(type << 1) | 1]);
+        }
+
+        return materialKey(counts, false);
+    }
+
+
+    /*
+        Table setup, once the file is mapped
+    */
+
+    // Splits the piece order into groups and computes the index multiplier of each
+    static void setGroups(const Table& table, PairsData& d, const int order[2], const int file)
+    {
+        int n        = 0;
+        int firstLen = table.hasPawns ? 0 : table.hasUniquePieces ? 3 : 2;
+
+        d.groupLen[n] = 1;
+
+        for (int i = 1; i < table.pieceCount; ++i) {
+            if (--firstLen > 0 || d.pieces[i] != d.pieces[i - 1])
+                d.groupLen[++n] = 1;
+            else
+                d.groupLen[n]++;
+        }
+
+        d.groupLen[++n] = 0;
+
+        // The order of the groups in the index is stored per table
+        const bool pawnsOnBothSides = table.hasPawns && table.pawnCount[1];
+
+        int next        = pawnsOnBothSides ? 2 : 1;
+        int freeSquares = 64 - d.groupLen[0] - (pawnsOnBothSides ? d.groupLen[1] : 0);
+        uint64_t idx    = 1;
+
+        for (int k = 0; next < n || k == order[0] || k == order[1]; ++k) {
+            if (k == order[0]) {
+                d.groupIdx[0] = idx;
+                idx *= table.hasPawns ? indexing.leadPawnsSize[d.groupLen[0]][file] : table.hasUniquePieces ? 31332 : 462;
+            }
+            else if (k == order[1]) {
+                d.groupIdx[1] = idx;
+                idx *= indexing.binomial[d.groupLen[1]][48 - d.groupLen[0]];
+            }
+            else {
+                d.groupIdx[next] = idx;
+                idx *= indexing.binomial[d.groupLen[next]][freeSquares];
+                freeSquares -= d.groupLen[next++];
+            }
+        }
+
+        d.groupIdx[n] = idx;
+    }
+
+
+    [[nodiscard]] static uint8_t setSymlen(PairsData& d, const int symbol, std::vector<bool>& visited)
+    {
+        visited[symbol] = true;
+
+        const int right = d.right(symbol);
+
+        if (right == 0xFFF)
+            return 0;
+
+        const int left = d.left(symbol);
+
+        if (!visited[left])
+            d.symlen[left] = setSymlen(d, left, visited);
+
+        if (!visited[right])
+            d.symlen[right] = setSymlen(d, right, visited);
+
+        return s_cast(uint8_t, d.symlen[left] + d.symlen[right] + 1);
+    }
+
+
+    [[nodiscard]] static const uint8_t* setSizes(PairsData& d, const uint8_t* data)
+    {
+        d.flags = *data++;
+
+        if (d.flags & Flags::SINGLE_VALUE) {
+            d.minSymLen = *data++;
+            return data;
+        }
+
+        const uint64_t tableSize = d.groupIdx[std::find(d.groupLen, d.groupLen + maxPieces, 0) - d.groupLen];
+
+        d.blockSize       = std::size_t{1} << *data++;
+        d.span            = std::size_t{1} << *data++;
+        d.sparseIndexSize = s_cast(std::size_t, (tableSize + d.span - 1) / d.span);
+
+        const uint8_t padding = *data++;
+
+        d.numBlocks       = readLE32(data);
+        d.blockLengthSize = d.numBlocks + padding; // So the sparse index never points past it
+        data += 4;
+
+        d.maxSymLen = *data++;
+        d.minSymLen = *data++;
+        d.lowestSym = data;
+
+        // Longer codes have lower values, so base64 is decreasing with the length
+        d.base64.assign(d.maxSymLen - d.minSymLen + 1, 0ULL);
+
+        for (int i = s_cast(int, d.base64.size()) - 2; i >= 0; --i)
+            d.base64[i] = (d.base64[i + 1] + readLE16(d.lowestSym + 2 * i) - readLE16(d.lowestSym + 2 * (i + 1))) / 2;
+
+        for (std::size_t i = 0; i < d.base64.size(); ++i)
+            d.base64[i] <<= 64 - i - d.minSymLen;
+
+        data += d.base64.size() * 2;
+
+        d.symlen.assign(readLE16(data), 0);
+        data += 2;
+
+        d.btree = data;
+
+        std::vector<bool> visited(d.symlen.size());
+
+        for (std::size_t symbol = 0; symbol < d.symlen.size(); ++symbol) {
+            if (!visited[symbol])
+                d.symlen[symbol] = setSymlen(d, s_cast(int, symbol), visited);
+        }
+
+        return data + d.symlen.size() * 3 + (d.symlen.size() & 1);
+    }
+
+
+    [[nodiscard]] static const uint8_t* setDTZMap(Table& table, const uint8_t* data, const int maxFile)
+    {
+        table.dtzMap = data;
+
+        for (int file = 0; file <= maxFile; ++file) {
+            PairsData& d = table.get(0, file);
+
+            if (!(d.flags & Flags::MAPPED))
+                continue;
+
+            if (d.flags & Flags::WIDE) {
+                data += reinterpret_cast<uintptr_t>(data) & 1; // Word aligned
+
+                for (int i = 0; i < 4; ++i) {
+                    d.mapIdx[i] = s_cast(uint16_t, (data - table.dtzMap) / 2 + 1);
+                    data += 2 * readLE16(data) + 2;
+                }
+            }
+            else {
+                for (int i = 0; i < 4; ++i) {
+                    d.mapIdx[i] = s_cast(uint16_t, data - table.dtzMap + 1);
+                    data += *data + 1;
+                }
+            }
+        }
+
+        return data + (reinterpret_cast<uintptr_t>(data) & 1);
+    }
+
+
+    static void setup(Table& table, const uint8_t* data)
+    {
+        ++data; // Split and pawn flags, known from the name
+
+        const int sides   = (table.type == TableType::WDL && table.key != table.key2) ? 2 : 1;
+        const int maxFile = table.hasPawns ? 3 : 0;
+
+        const bool pawnsOnBothSides = table.hasPawns && table.pawnCount[1];
+
+        for (int file = 0; file <= maxFile; ++file) {
+            const int order[2][2] = {
+                {*data & 0xF, pawnsOnBothSides ? *(data + 1) & 0xF : 0xF},
+                {*data >> 4, pawnsOnBothSides ? *(data + 1) >> 4 : 0xF}
+            };
+            data += 1 + pawnsOnBothSides;
+
+            for (int k = 0; k < table.pieceCount; ++k, ++data) {
+                for (int i = 0; i < sides; ++i)
+                    table.get(i, file).pieces[k] = i ? *data >> 4 : *data & 0xF;
+            }
+
+            for (int i = 0; i < sides; ++i)
+                setGroups(table, table.get(i, file), order[i], file);
+        }
+
+        data += reinterpret_cast<uintptr_t>(data) & 1;
+
+        for (int file = 0; file <= maxFile; ++file) {
+            for (int i = 0; i < sides; ++i)
+                data = setSizes(table.get(i, file), data);
+        }
+
+        if (table.type == TableType::DTZ)
+            data = setDTZMap(table, data, maxFile);
+
+        for (int file = 0; file <= maxFile; ++file) {
+            for (int i = 0; i < sides; ++i) {
+                table.get(i, file).sparseIndex = data;
+                data += table.get(i, file).sparseIndexSize * 6;
+            }
+        }
+
+        for (int file = 0; file <= maxFile; ++file) {
+            for (int i = 0; i < sides; ++i) {
+                table.get(i, file).blockLength = data;
+                data += table.get(i, file).blockLengthSize * 2;
+            }
+        }
+
+        for (int file = 0; file <= maxFile; ++file) {
+            for (int i = 0; i < sides; ++i) {
+                data = reinterpret_cast<const uint8_t*>((reinterpret_cast<uintptr_t>(data) + 0x3F) & ~uintptr_t{0x3F}); // Cache line aligned
+                table.get(i, file).data = data;
+                data += s_cast(std::size_t, table.get(i, file).numBlocks) * table.get(i, file).blockSize;
+            }
+        }
+    }
+
+
+    // Maps the file on first use, safe to call from every search thread
+    [[nodiscard]] static bool isMapped(Table& table)
+    {
+        if (table.ready.load(std::memory_order_acquire))
+            return table.file.data;
+
+        std::lock_guard<std::mutex> lock(mappingMutex);
+
+        if (table.ready.load(std::memory_order_relaxed))
+            return table.file.data;
+
+        const std::string fileName = table.name + (table.type == TableType::WDL ? ".rtbw" : ".rtbz");
+
+        for (const std::string& directory : directories) {
+            if (table.file.open(directory + "/" + fileName))
+                break;
+        }
+
+        constexpr uint8_t magics[2][4] = {
+            {0x71, 0xE8, 0x23, 0x5D}, // WDL
+            {0xD7, 0x66, 0x0C, 0xA5}  // DTZ
+        };
+
+        if (table.file.data) {
+            const uint8_t* magic = magics[table.type == TableType::DTZ];
+
+            if (table.file.size < 4 || !std::equal(magic, magic + 4, table.file.data)) {
+                std::cout << "info string corrupted tablebase file " << fileName << std::endl;
+                table.file.close();
+            }
+            else {
+                setup(table, table.file.data + 4);
+            }
+        }
+
+        table.ready.store(true, std::memory_order_release);
+        return table.file.data;
+    }
+
+
+    /*
+        Probing
+    */
+
+    [[nodiscard]] static int decompressPairs(const PairsData& d, const uint64_t idx)
+    {
+        if (d.flags & Flags::SINGLE_VALUE)
+            return d.minSymLen;
+
+        // The sparse index entry k points at the value with index k * span + span / 2
+        const uint32_t k = s_cast(uint32_t, idx / d.span);
+
+        uint32_t block = readLE32(d.sparseIndex + 6 * k);
+        int offset     = s_cast(int, readLE16(d.sparseIndex + 6 * k + 4));
+
+        offset += s_cast(int, idx % d.span) - s_cast(int, d.span / 2);
+
+        // Walk to the block that holds idx
+        while (offset < 0)
+            offset += s_cast(int, readLE16(d.blockLength + 2 * --block)) + 1;
+
+        while (offset > s_cast(int, readLE16(d.blockLength + 2 * block)))
+            offset -= s_cast(int, readLE16(d.blockLength + 2 * block++)) + 1;
+
+        const uint8_t* pointer = d.data + s_cast(uint64_t, block) * d.blockSize;
+
+        // The block starts with a symbol, decode until the one covering our offset
+        uint64_t buffer = readBE64(pointer);
+        int bufferSize  = 64;
+        pointer += 8;
+
+        int symbol;
+
+        while (true) {
+            int length = 0; // Minus minSymLen
+
+            while (buffer < d.base64[length])
+                ++length;
+
+            symbol = s_cast(uint16_t, ((buffer - d.base64[length]) >> (64 - length - d.minSymLen)) + readLE16(d.lowestSym + 2 * length));
+
+            if (offset < d.symlen[symbol] + 1)
+                break;
+
+            offset -= d.symlen[symbol] + 1;
+            length += d.minSymLen;
+
+            buffer <<= length;
+            bufferSize -= length;
+
+            if (bufferSize <= 32) {
+                bufferSize += 32;
+                buffer |= s_cast(uint64_t, readBE32(pointer)) << (64 - bufferSize);
+                pointer += 4;
+            }
+        }
+
+        // Expand the pair tree down to the value, children are adjacent in the sequence
+        while (d.symlen[symbol]) {
+            const int left = d.left(symbol);
+
+            if (offset < d.symlen[left] + 1) {
+                symbol = left;
+            }
+            else {
+                offset -= d.symlen[left] + 1;
+                symbol = d.right(symbol);
+            }
+        }
+
+        return d.left(symbol);
+    }
+
+
+    // DTZ values are stored remapped by frequency and in moves rather than plies where that is exact
+    [[nodiscard]] static int mapScore(Table& table, const int file, int value, const WDL wdl)
+    {
+        if (table.type == TableType::WDL)
+            return value - 2;
+
+        constexpr int wdlMap[5] = {1, 3, 0, 2, 0};
+
+        const PairsData& d = table.get(0, file);
+
+        if (d.flags & Flags::MAPPED) {
+            const int index = d.mapIdx[wdlMap[wdl + 2]] + value;
+
+            if (d.flags & Flags::WIDE)
+                value = s_cast(int, readLE16(table.dtzMap + 2 * index));
+            else
+                value = table.dtzMap[index];
+        }
+
+        if ((wdl == WDL::WIN && !(d.flags & Flags::WIN_PLIES)) || (wdl == WDL::LOSS && !(d.flags & Flags::LOSS_PLIES)) ||
+            wdl == WDL::CURSED_WIN || wdl == WDL::BLESSED_LOSS)
+            value *= 2;
+
+        return value + 1;
+    }
+
+
+    [[nodiscard]] static bool isPawnMoreLeading(const int a, const int b)
+    {
+        return indexing.mapPawns[a] < indexing.mapPawns[b];
+    }
+
+
+    // Index of the position in the table, then its value
+    [[nodiscard]] static int probeTable(const Engine& engine, Table& table, const WDL wdl, ProbeState& state)
+    {
+        const Board& board = engine.board;
+
+        int squares[maxPieces];
+        int pieces[maxPieces];
+        int size         = 0;
+        int leadPawnsCnt = 0;
+        int tableFile    = 0;
+
+        Bitboard leadPawns = 0ULL;
+
+        // Tables have the stronger side as White, and only White to move when both sides are equal
+        const bool isSymmetricBlackToMove = (table.key == table.key2 && !engine.isWhiteTurn);
+        const bool isBlackStronger        = (materialKey(board) != table.key);
+        const bool isFlipped              = isSymmetricBlackToMove || isBlackStronger;
+
+        const int flipColor   = isFlipped * 8;
+        const int flipSquares = isFlipped * 56;
+        const int stm         = isFlipped ^ !engine.isWhiteTurn;
+
+        // Split by the file of the leading pawn, the one nearest the edge and lowest
+        if (table.hasPawns) {
+            const int leadPiece = table.get(0, 0).pieces[0] ^ flipColor;
+
+            Bitboard pawns = leadPawns = board.bitboards[leadPiece < 8 ? Pieces::Piece::W_PAWN : Pieces::Piece::B_PAWN];
+
+            while (pawns) {
+                squares[size++] = std::countr_zero(pawns) ^ flipSquares;
+                pawns &= pawns - 1;
+            }
+
+            leadPawnsCnt = size;
+
+            std::swap(squares[0], *std::max_element(squares, squares + leadPawnsCnt, isPawnMoreLeading));
+
+            tableFile = std::min(squares[0] & 7, 7 - (squares[0] & 7));
+        }
+
+        // DTZ tables only have one side to move
+        if (table.type == TableType::DTZ) {
+            const uint8_t flags = table.get(0, tableFile).flags;
+
+            if ((flags & Flags::STM) != stm && !(table.key == table.key2 && !table.hasPawns)) {
+                state = ProbeState::CHANGE_STM;
+                return 0;
+            }
+        }
+
+        Bitboard rest = (board.occupiedSquares[0] | board.occupiedSquares[1]) ^ leadPawns;
+
+        while (rest) {
+            const int square = std::countr_zero(rest);
+            rest &= rest - 1;
+
+            squares[size]  = square ^ flipSquares;
+            pieces[size++] = tablePiece(board.mailbox[square]) ^ flipColor;
+        }
+
+        PairsData& d = table.get(stm, tableFile);
+
+        // Same piece order as the table
+        for (int i = leadPawnsCnt; i < size - 1; ++i) {
+            for (int j = i + 1; j < size; ++j) {
+                if (d.pieces[i] == pieces[j]) {
+                    std::swap(pieces[i], pieces[j]);
+                    std::swap(squares[i], squares[j]);
+                    break;
+                }
+            }
+        }
+
+        // Leading piece on files a-d
+        if ((squares[0] & 7) > 3) {
+            for (int i = 0; i < size; ++i)
+                squares[i] ^= 7;
+        }
+
+        uint64_t idx;
+
+        if (table.hasPawns) {
+            idx = indexing.leadPawnIdx[leadPawnsCnt][squares[0]];
+
+            std::stable_sort(squares + 1, squares + leadPawnsCnt, isPawnMoreLeading);
+
+            for (int i = 1; i < leadPawnsCnt; ++i)
+                idx += indexing.binomial[i][indexing.mapPawns[squares[i]]];
+        }
+        else {
+            // Without pawns the leading piece also goes below rank 5 and below the a1-h8 diagonal
+            if ((squares[0] >> 3) > 3) {
+                for (int i = 0; i < size; ++i)
+                    squares[i] ^= 56;
+            }
+
+            for (int i = 0; i < d.groupLen[0]; ++i) {
+                if (!offDiagonal(squares[i]))
+                    continue;
+
+                if (offDiagonal(squares[i]) > 0) {
+                    for (int j = i; j < size; ++j)
+                        squares[j] = ((squares[j] >> 3) | (squares[j] << 3)) & 63;
+                }
+                break;
+            }
+
+            if (table.hasUniquePieces) {
+                // Three unique pieces are encoded together, in 31332 ways
+                const int adjust1 = squares[1] > squares[0];
+                const int adjust2 = (squares[2] > squares[0]) + (squares[2] > squares[1]);
+
+                if (offDiagonal(squares[0]))
+                    idx = (indexing.mapA1D1D4[squares[0]] * 63 + (squares[1] - adjust1)) * 62 + squares[2] - adjust2;
+
+                else if (offDiagonal(squares[1]))
+                    idx = (6 * 63 + (squares[0] >> 3) * 28 + indexing.mapB1H1H7[squares[1]]) * 62 + squares[2] - adjust2;
+
+                else if (offDiagonal(squares[2]))
+                    idx = 6 * 63 * 62 + 4 * 28 * 62 + (squares[0] >> 3) * 7 * 28 + ((squares[1] >> 3) - adjust1) * 28 +
+                          indexing.mapB1H1H7[squares[2]];
+
+                else
+                    idx = 6 * 63 * 62 + 4 * 28 * 62 + 4 * 7 * 28 + (squares[0] >> 3) * 7 * 6 + ((squares[1] >> 3) - adjust1) * 6 +
+                          ((squares[2] >> 3) - adjust2);
+            }
+            else {
+                // Otherwise just the kings, in 462 ways
+                idx = indexing.mapKK[indexing.mapA1D1D4[squares[0]]][squares[1]];
+            }
+        }
+
+
+        // Remaining groups, each as a combination of the squares left by the groups before it
+        idx *= d.groupIdx[0];
+
+        int* groupSquares   = squares + d.groupLen[0];
+        bool remainingPawns = table.hasPawns && table.pawnCount[1];
+
+        for (int next = 1; d.groupLen[next]; ++next) {
+            std::stable_sort(groupSquares, groupSquares + d.groupLen[next]);
+
+            uint64_t n = 0;
+
+            for (int i = 0; i < d.groupLen[next]; ++i) {
+                const int square = groupSquares[i];
+                const int adjust = s_cast(int, std::count_if(squares, groupSquares, [square](const int other) { return square > other; }));
+
+                n += indexing.binomial[i + 1][square - adjust - 8 * remainingPawns];
+            }
+
+            remainingPawns = false;
+            idx += n * d.groupIdx[next];
+            groupSquares += d.groupLen[next];
+        }
+
+        return mapScore(table, tableFile, decompressPairs(d, idx), wdl);
+    }
+
+
+    [[nodiscard]] static int probeTable(const Engine& engine, const TableType type, ProbeState& state, const WDL wdl = WDL::DRAW)
+    {
+        const Bitboard occupied = engine.board.occupiedSquares[0] | engine.board.occupiedSquares[1];
+
+        // Bare kings
+        if (std::popcount(occupied) == 2)
+            return WDL::DRAW;
+
+        const auto it = tablesByKey.find(materialKey(engine.board));
+
+        if (it == tablesByKey.end()) {
+            state = ProbeState::FAIL;
+            return 0;
+        }
+
+        Table& table = (type == TableType::WDL) ? it->second->wdl : it->second->dtz;
+
+        if (!isMapped(table)) {
+            state = ProbeState::FAIL;
+            return 0;
+        }
+
+        return probeTable(engine, table, wdl, state);
+    }
+
+
+    [[nodiscard]] static bool isZeroing(const Engine& engine, const Pieces::Move& move)
+    {
+        return engine.board.mailbox[move.to()] != Pieces::Piece::NONE || move.isEnPassant() ||
+               (engine.board.mailbox[move.from()] >> 1) == Pieces::PieceType::PAWN;
+    }
+
+    [[nodiscard]] static bool isCapture(const Engine& engine, const Pieces::Move& move)
+    {
+        return engine.board.mailbox[move.to()] != Pieces::Piece::NONE || move.isEnPassant();
+    }
+
+
+    // DTZ of the move before a zeroing move, from the result after it
+    [[nodiscard]] static int dtzBeforeZeroing(const WDL wdl)
+    {
+        return wdl == WDL::WIN          ? 1
+             : wdl == WDL::CURSED_WIN   ? 101
+             : wdl == WDL::BLESSED_LOSS ? -101
+             : wdl == WDL::LOSS         ? -1
+                                        : 0;
+    }
+
+
+    /*
+        Tables store "don't care" values where a capture wins and may store
+        a loss where a capture draws, and nothing for en passant rights, so
+        the captures (for DTZ also the pawn moves) are searched first and the
+        best of them and the stored value is the result.
+    */
+    [[nodiscard]] static WDL search(Engine& engine, ProbeState& state, const bool checkZeroingMoves)
+    {
+        WDL bestValue = WDL::LOSS;
+        WDL value;
+
+        const Engine::MoveList moves = engine.generateAllMoves();
+        int moveCount                = 0;
+
+        for (int i = 0; i < moves.used; ++i) {
+            const Pieces::Move& move = moves.moves[i];
+
+            if (!(checkZeroingMoves ? isZeroing(engine, move) : isCapture(engine, move)))
+                continue;
+
+            ++moveCount;
+
+            engine.makeMove(move);
+            value = s_cast(WDL, -search(engine, state, false));
+            engine.undoMove();
+
+            if (state == ProbeState::FAIL)
+                return WDL::DRAW;
+
+            if (value > bestValue) {
+                bestValue = value;
+
+                if (value >= WDL::WIN) {
+                    state = ProbeState::ZEROING_BEST_MOVE;
+                    return value;
+                }
+            }
+        }
+
+        // Every move was searched, the stored value could be wrong (en passant, only captures left)
+        const bool noMoreMoves = moveCount && moveCount == moves.used;
+
+        if (noMoreMoves) {
+            value = bestValue;
+        }
+        else {
+            value = s_cast(WDL, probeTable(engine, TableType::WDL, state));
+
+            if (state == ProbeState::FAIL)
+                return WDL::DRAW;
+        }
+
+        if (bestValue >= value) {
+            state = (bestValue > WDL::DRAW || noMoreMoves) ? ProbeState::ZEROING_BEST_MOVE : ProbeState::OK;
+            return bestValue;
+        }
+
+        state = ProbeState::OK;
+        return value;
+    }
+
+
+    [[nodiscard]] static WDL probeWDL(Engine& engine, ProbeState& state)
+    {
+        state = ProbeState::OK;
+        return search(engine, state, false);
+    }
+
+
+    [[nodiscard]] static int probeDTZ(Engine& engine, ProbeState& state)
+    {
+        state = ProbeState::OK;
+
+        const WDL wdl = search(engine, state, true);
+
+        // No DTZ for draws
+        if (state == ProbeState::FAIL || wdl == WDL::DRAW)
+            return 0;
+
+        if (state == ProbeState::ZEROING_BEST_MOVE)
+            return dtzBeforeZeroing(wdl);
+
+        int dtz = probeTable(engine, TableType::DTZ, state, wdl);
+
+        if (state == ProbeState::FAIL)
+            return 0;
+
+        if (state != ProbeState::CHANGE_STM)
+            return (dtz + 100 * (wdl == WDL::BLESSED_LOSS || wdl == WDL::CURSED_WIN)) * (wdl > 0 ? 1 : -1);
+
+        // Stored for the other side to move, take the best reply one ply down
+        const Engine::MoveList moves = engine.generateAllMoves();
+        int minDTZ                   = 0xFFFF;
+
+        for (int i = 0; i < moves.used; ++i) {
+            const Pieces::Move& move = moves.moves[i];
+            const bool zeroing       = isZeroing(engine, move);
+
+            engine.makeMove(move);
+
+            // A zeroing move resets the count, its DTZ comes from the result after it
+            dtz = zeroing ? -dtzBeforeZeroing(search(engine, state, false)) : -probeDTZ(engine, state);
+
+            if (dtz == 1 && engine.isInCheck() && engine.generateAllMoves().used == 0)
+                minDTZ = 1;
+
+            if (!zeroing)
+                dtz += (dtz > 0) - (dtz < 0);
+
+            // Skip draws, and when winning only take winning moves
+            if (dtz < minDTZ && (dtz > 0) - (dtz < 0) == (wdl > 0) - (wdl < 0))
+                minDTZ = dtz;
+
+            engine.undoMove();
+
+            if (state == ProbeState::FAIL)
+                return 0;
+        }
+
+        // No legal moves, mated
+        return minDTZ == 0xFFFF ? -1 : minDTZ;
+    }
+
+
+    /*
+        Setup from the UCI option
+    */
+
+    // Adds the table of a file name like "KRPvKR", both colors map to it
+    static void addTable(const std::string& name)
+    {
+        const std::size_t separator = name.find('v');
+
+        if (separator == std::string::npos || name.size() < 4 || name.size() - 1 > maxPieces)
+            return;
+
+        const std::string sides[2] = {name.substr(0, separator), name.substr(separator + 1)}; // White, Black
+
+        constexpr const char* pieceChars = "PNBRQK";
+
+        int counts[2][5] = {};
+
+        for (int side = 0; side < 2; ++side) {
+            if (sides[side].empty() || sides[side][0] != 'K')
+                return;
+
+            for (std::size_t i = 1; i < sides[side].size(); ++i) {
+                const char* type = std::strchr(pieceChars, sides[side][i]);
+
+                if (!type || *type == 'K')
+                    return;
+
+                ++counts[!side][type - pieceChars];
+            }
+        }
+
+        const uint64_t key = materialKey(counts, false);
+
+        if (tablesByKey.count(key))
+            return;
+
+        TablePair& pair = tables.emplace_back();
+
+        for (Table* table : {&pair.wdl, &pair.dtz}) {
+            table->type       = (table == &pair.wdl) ? TableType::WDL : TableType::DTZ;
+            table->name       = name;
+            table->key        = key;
+            table->key2       = materialKey(counts, true);
+            table->pieceCount = s_cast(int, name.size()) - 1;
+            table->hasPawns   = counts[0][0] || counts[1][0];
+
+            for (int color = 0; color < 2; ++color) {
+                for (int type = 0; type < 5; ++type) {
+                    if (counts[color][type] == 1)
+                        table->hasUniquePieces = true;
+                }
+            }
+
+            // The side with fewer pawns leads, it compresses better
+            const bool isWhiteLeading = !counts[0][0] || (counts[1][0] && counts[0][0] >= counts[1][0]);
+
+            table->pawnCount[0] = counts[isWhiteLeading][0];
+            table->pawnCount[1] = counts[!isWhiteLeading][0];
+        }
+
+        tablesByKey[pair.wdl.key]  = &pair;
+        tablesByKey[pair.wdl.key2] = &pair;
+
+        cardinality = std::max(cardinality, pair.wdl.pieceCount);
+    }
+
+
+    void init(const std::string& paths)
+    {
+        for (TablePair& pair : tables) {
+            pair.wdl.file.close();
+            pair.dtz.file.close();
+        }
+
+        tablesByKey.clear();
+        tables.clear();
+        directories.clear();
+        cardinality = 0;
+
+        if (paths.empty() || paths == "<empty>")
+            return;
+
+#ifdef _WIN32
+        constexpr char pathSeparator = ';';
+#else
+        constexpr char pathSeparator = ':';
+#endif
+
+        std::size_t start = 0;
+
+        while (start <= paths.size()) {
+            const std::size_t end = std::min(paths.find(pathSeparator, start), paths.size());
+
+            if (end > start)
+                directories.push_back(paths.substr(start, end - start));
+
+            start = end + 1;
+        }
+
+        // Only WDL files count, DTZ is optional
+        for (const std::string& directory : directories) {
+            std::error_code error;
+
+            for (const auto& entry : std::filesystem::directory_iterator(directory, error)) {
+                if (entry.path().extension() == ".rtbw")
+                    addTable(entry.path().stem().string());
+            }
+        }
+
+        std::cout << "info string found " << tables.size() << " tablebases" << std::endl;
+    }
+
+
+    WDL probeWDL(Engine& engine, bool& success)
+    {
+        ProbeState state;
+        const WDL wdl = probeWDL(engine, state);
+
+        success = (state != ProbeState::FAIL);
+        return wdl;
+    }
+
+
+    int probeDTZ(Engine& engine, bool& success)
+    {
+        ProbeState state;
+        const int dtz = probeDTZ(engine, state);
+
+        success = (state != ProbeState::FAIL);
+        return dtz;
+    }
+
+
+    bool filterRootMoves(Engine& engine, Engine::MoveList& rootMoves)
+    {
+        const Engine::MoveList moves = engine.generateAllMoves();
+
+        if (!moves.used)
+            return false;
+
+        int ranks[256];
+        ProbeState state = ProbeState::OK;
+
+        // Plies already played towards the 50-move rule
+        const int count50 = engine.board.halfmoveClock;
+
+        // Rank by DTZ: the quickest win, then the slowest loss. Thresholds as in tbprobe's root_probe:
+        // a win that needs more plies than the 50-move rule leaves is a draw, still ranked above real
+        // draws in case the opponent errs, and a loss the rule may save ranks above the real losses
+        for (int i = 0; i < moves.used && state != ProbeState::FAIL; ++i) {
+            const bool zeroing = isZeroing(engine, moves.moves[i]);
+
+            engine.makeMove(moves.moves[i]);
+
+            int dtz;
+
+            if (zeroing) {
+                dtz = dtzBeforeZeroing(s_cast(WDL, -probeWDL(engine, state)));
+            }
+            else {
+                dtz = -probeDTZ(engine, state);
+                dtz += (dtz > 0) - (dtz < 0);
+            }
+
+            // Mate in one
+            if (dtz == 2 && engine.isInCheck() && engine.generateAllMoves().used == 0)
+                dtz = 1;
+
+            engine.undoMove();
+
+            ranks[i] = dtz > 0 ? (dtz + count50 <= 99 ? maxDTZ - dtz : maxDTZ / 2 - (dtz + count50))
+                     : dtz < 0 ? (-dtz * 2 + count50 < 100 ? -maxDTZ - dtz : -maxDTZ / 2 + (-dtz + count50))
+                               : 0;
+        }
+
+        // Without DTZ tables fall back to the result alone
+        if (state == ProbeState::FAIL) {
+            constexpr int wdlRanks[5] = {-maxDTZ, -maxDTZ + 101, 0, maxDTZ - 101, maxDTZ};
+
+            for (int i = 0; i < moves.used; ++i) {
+                engine.makeMove(moves.moves[i]);
+                const WDL wdl = s_cast(WDL, -probeWDL(engine, state));
+                engine.undoMove();
+
+                if (state == ProbeState::FAIL)
+                    return false;
+
+                ranks[i] = wdlRanks[wdl + 2];
+            }
+        }
+
+        const int bestRank = *std::max_element(ranks, ranks + moves.used);
+
+        rootMoves.used = 0;
+
+        for (int i = 0; i < moves.used; ++i) {
+            if (ranks[i] == bestRank)
+                rootMoves.moves[rootMoves.used++] = moves.moves[i];
+        }
+
+        return true;
+    }
+
+
+    CheckResult checkProbes()
+    {
+        constexpr int anyDTZ = 0x7FFF; // Only the sign is known
+
+        struct Reference
+        {
+            const char* fen;
+            WDL wdl;
+            int dtz;
+        };
+
+        // 3-piece values from a separate retrograde solver, KRPvKR are the Lucena and Philidor positions
+        constexpr Reference references[] = {
+            {"7k/8/6K1/8/8/8/8/1Q6 w - - 0 1",      WDL::WIN,  1},
+            {"8/8/8/4k3/8/8/8/KQ6 w - - 0 1",       WDL::WIN,  17},
+            {"8/8/8/4k3/8/8/8/KQ6 b - - 0 1",       WDL::LOSS, -18},
+            {"8/8/8/8/8/2k5/1Q6/7K b - - 0 1",      WDL::DRAW, 0},
+            {"k7/8/2K5/8/8/8/8/7R w - - 0 1",       WDL::WIN,  3},
+            {"8/8/8/4k3/8/8/8/R3K3 w - - 0 1",      WDL::WIN,  27},
+            {"8/8/8/4k3/8/8/8/R3K3 b - - 0 1",      WDL::LOSS, -28},
+            {"8/8/8/8/8/8/1kR5/7K b - - 0 1",       WDL::DRAW, 0},
+            {"4k3/8/4K3/4P3/8/8/8/8 w - - 0 1",     WDL::WIN,  3},
+            {"4k3/8/4P3/4K3/8/8/8/8 w - - 0 1",     WDL::DRAW, 0},
+            {"1K1k4/1P6/8/8/8/8/r7/2R5 w - - 0 1",  WDL::WIN,  anyDTZ},
+            {"4k3/8/r7/4PK2/8/8/8/3R4 b - - 0 1",   WDL::DRAW, 0}
+        };
+
+        Engine engine;
+        CheckResult result;
+
+        result.positions = s_cast(int, std::size(references));
+
+        for (const Reference& reference : references) {
+            std::istringstream stream(reference.fen);
+            std::vector<std::string> fen;
+
+            for (std::string field; stream >> field;)
+                fen.push_back(field);
+
+            engine.loadFEN(fen);
+
+            bool wdlSuccess;
+            bool dtzSuccess;
+
+            const WDL wdl = probeWDL(engine, wdlSuccess);
+            const int dtz = probeDTZ(engine, dtzSuccess);
+
+            std::string info = "info string tbcheck " + std::string(reference.fen);
+
+            if (!wdlSuccess) {
+                std::cout << info + " no table\n";
+                continue;
+            }
+
+            // DTZ may be one ply off, see probeDTZ
+            const int sign   = (reference.wdl > 0) - (reference.wdl < 0);
+            const bool dtzOk = !dtzSuccess || (reference.dtz == anyDTZ ? ((dtz > 0) - (dtz < 0)) == sign
+                                                                       : std::abs(dtz - reference.dtz) <= 1);
+            const bool ok    = (wdl == reference.wdl) && dtzOk;
+
+            info += " wdl " + std::to_string(wdl);
+            info += dtzSuccess ? " dtz " + std::to_string(dtz) : " no dtz table";
+            info += ok ? " ok" : " wrong";
+
+            std::cout << info + "\n";
+
+            ++result.probed;
+            result.wrong += !ok;
+        }
+
+        std::cout << std::flush;
+
+        return result;
+    }
+
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+#include "engine.hpp"
+
+
+namespace Syzygy
+{
+
+    /*
+        Syzygy endgame tablebases
+
+        .rtbw files hold win/draw/loss, .rtbz files the distance to the
+        next capture or pawn move (DTZ) of the winning or losing side.
+        SyzygyPath is only scanned for file names, each file is memory
+        mapped the first time a position needs it.
+
+        Tables don't store positions with castling rights and store
+        "don't care" values for positions with a winning capture, so every
+        probe first tries the captures (and for DTZ the pawn moves) itself.
+
+        Probes give the result with the 50-move count at zero. The root
+        ranking adds the board's count, a win that can't reach its next
+        zeroing move in time is ranked as the draw it is.
+    */
+
+    enum WDL
+    {
+        LOSS         = -2,
+        BLESSED_LOSS = -1, // Lost, but drawn by the 50-move rule
+        DRAW         = 0,
+        CURSED_WIN   = 1, // Won, but drawn by the 50-move rule
+        WIN          = 2
+    };
+
+
+    // Most pieces (kings included) of any table found, 0 without tablebases
+    inline int cardinality = 0;
+
+    // Looks for .rtbw files in the directories (separated by ':', ';' on Windows), "<empty>" for none
+    void init(const std::string& paths);
+
+    // Result for the side to move, success is false if a needed table is missing
+    [[nodiscard]] WDL probeWDL(Engine& engine, bool& success);
+
+    // Plies to the next zeroing move, positive when winning, 0 for draws; one ply off at most
+    [[nodiscard]] int probeDTZ(Engine& engine, bool& success);
+
+    // Keeps the moves that make the fastest progress towards the best result under the 50-move rule, false if the probes failed
+    bool filterRootMoves(Engine& engine, Engine::MoveList& rootMoves);
+
+    struct CheckResult
+    {
+        int positions = 0;
+        int probed    = 0; // Positions whose tables were found
+        int wrong     = 0;
+    };
+
+    // Probes regression positions (KQvK, KRvK, KPvK, KRPvKR) and prints each result
+    [[nodiscard]] CheckResult checkProbes();
+
+}
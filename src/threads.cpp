@@ -0,0 +1,132 @@
+#include "threads.hpp"
+
+
+ThreadPool::ThreadPool()
+{
+    setThreadCount(1);
+}
+
+
+ThreadPool::~ThreadPool()
+{
+    setThreadCount(0);
+}
+
+
+void ThreadPool::setThreadCount(int count)
+{
+    waitForSearchFinished();
+
+    // Shut down existing workers
+    for (auto& worker : workers) {
+        {
+            std::lock_guard<std::mutex> lock(worker->mutex);
+            worker->exit = true;
+        }
+        worker->condition.notify_one();
+        worker->thread.join();
+    }
+
+    workers.clear();
+
+    for (int i = 0; i < count; ++i) {
+        workers.push_back(std::make_unique<Worker>());
+
+        Worker& worker         = *workers.back();
+        worker.engine->threadId = i;
+        worker.thread           = std::thread(&Worker::idleLoop, &worker, std::ref(*this));
+    }
+}
+
+
+void ThreadPool::startSearch(const Engine& rootEngine, const Search::Limits& limits)
+{
+    waitForSearchFinished();
+
+    Search::stopSignal = false;
+    Search::totalNodes = 0;
+    Search::tbHits     = 0;
+
+    TT::table.newSearch();
+
+    // Every thread searches its own copy of the root position. All are set up before any is woken, and
+    // worker 0 last: it may start on its flag alone and must find the helpers searching when it stops them
+    for (std::size_t i = workers.size(); i-- > 0;) {
+        Worker& worker = *workers[i];
+
+        *worker.engine          = rootEngine;
+        worker.engine->threadId   = s_cast(int, i);
+        worker.engine->heuristics = worker.heuristics.get();
+        worker.engine->pawnTable  = worker.pawnTable.get();
+        worker.limits             = limits;
+
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.searching = true;
+    }
+
+    for (auto& worker : workers)
+        worker->condition.notify_one();
+}
+
+
+void ThreadPool::clear()
+{
+    waitForSearchFinished();
+
+    for (auto& worker : workers) {
+        worker->heuristics->clear();
+        worker->pawnTable->clear();
+    }
+}
+
+
+void ThreadPool::waitForSearchFinished()
+{
+    for (auto& worker : workers)
+        worker->waitForSearchFinished();
+}
+
+
+void ThreadPool::Worker::waitForSearchFinished()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    condition.wait(lock, [this] { return !searching; });
+}
+
+
+void ThreadPool::Worker::idleLoop(ThreadPool& pool)
+{
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this] { return searching || exit; });
+
+            if (exit)
+                return;
+        }
+
+        const std::string move = engine->getEngineMove(limits);
+
+        if (engine->threadId == 0) {
+            // Stop the helpers before answering so the next "go" starts clean
+            Search::stopSignal = true;
+
+            for (std::size_t i = 1; i < pool.workers.size(); ++i)
+                pool.workers[i]->waitForSearchFinished();
+
+            // Send bestmove (move that will be played by the engine)
+            std::string bestmove = "bestmove " + move;
+
+            if (!engine->ponderMove.isNull())
+                bestmove += " ponder " + Utils::toUCI(engine->ponderMove);
+
+            std::cout << bestmove + "\n" << std::flush;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            searching = false;
+        }
+        condition.notify_all();
+    }
+}
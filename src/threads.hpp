@@ -0,0 +1,54 @@
+#pragma once
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "engine.hpp"
+#include "search.hpp"
+
+
+/*
+    Lazy SMP thread pool
+
+    Every worker runs its own iterative deepening on its own copy of the
+    root position and search stack. They only share the transposition
+    table, which is where the speedup comes from. Worker 0 is the main
+    thread: it owns the clock, prints info and bestmove, and stops the
+    helpers once it is done. Threads are created once and reused.
+*/
+
+struct ThreadPool
+{
+    struct Worker
+    {
+        std::unique_ptr<Engine> engine                 = std::make_unique<Engine>();
+        std::unique_ptr<Search::Heuristics> heuristics = std::make_unique<Search::Heuristics>();
+        std::unique_ptr<Pawns::Table> pawnTable        = std::make_unique<Pawns::Table>();
+        Search::Limits limits                          = {};
+
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable condition;
+
+        bool searching = false;
+        bool exit      = false;
+
+        void idleLoop(ThreadPool& pool);
+        void waitForSearchFinished();
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    ThreadPool();
+    ~ThreadPool();
+
+    void setThreadCount(int count);
+
+    // Forget move ordering history and cached pawn structures, for "ucinewgame"
+    void clear();
+
+    void startSearch(const Engine& rootEngine, const Search::Limits& limits);
+    void waitForSearchFinished();
+};
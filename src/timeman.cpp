@@ -0,0 +1,67 @@
+#include <algorithm>
+
+#include "timeman.hpp"
+#include "utils.hpp"
+
+
+void TimeManager::init(const Search::Limits& limits, bool isWhite)
+{
+    const int64_t time = std::max<int64_t>(limits.time[isWhite], 0);
+    const int64_t inc  = std::max<int64_t>(limits.inc[isWhite], 0);
+
+    // A clock was sent, even an empty one or only the opponent's: never search without a limit
+    isTimed   = (limits.movetime > 0) || limits.hasClock;
+    usesClock = !limits.movetime && limits.hasClock;
+
+    bestMoveStability = 0;
+    previousScore     = 0;
+
+    if (limits.movetime > 0) {
+        hardLimit = std::max<int64_t>(limits.movetime - moveOverhead, 1);
+        softLimit = hardLimit;
+        return;
+    }
+
+    if (!usesClock)
+        return;
+
+    // Nothing left on our clock, only the increment can be spent
+    if (!time) {
+        hardLimit = std::max<int64_t>(std::max<int64_t>(inc * 3 / 4, 1) - moveOverhead, 1);
+        softLimit = hardLimit;
+        return;
+    }
+
+    // Keep the overhead in reserve for every move still to be played before the next time control
+    const int movesToGo   = limits.movesToGo ? std::min(limits.movesToGo, 50) : 40;
+    const int64_t reserve = std::min<int64_t>(moveOverhead * std::min(movesToGo, 10), time / 2);
+    const int64_t usable  = std::max<int64_t>(time - reserve, 1);
+
+    softLimit = usable / movesToGo + inc * 3 / 4;
+    hardLimit = std::min<int64_t>(softLimit * 5, usable * 3 / 4);
+
+    // Never plan to use more than we are allowed to spend at most
+    softLimit = std::min(softLimit, hardLimit);
+    hardLimit = std::max<int64_t>(hardLimit, 1);
+}
+
+
+bool TimeManager::shouldStop(int64_t elapsed, int depth, int score, bool bestMoveChanged)
+{
+    if (!usesClock)
+        return false;
+
+    bestMoveStability = bestMoveChanged ? 0 : std::min(bestMoveStability + 1, 4);
+
+    // A best move that keeps changing needs more time, a settled one less
+    constexpr double stabilityScale[5] = {1.6, 1.2, 1.0, 0.85, 0.7};
+    double scale = stabilityScale[bestMoveStability];
+
+    // Score dropping between iterations: something went wrong, look harder
+    if (depth > 1 && score < previousScore)
+        scale *= 1.0 + std::min(previousScore - score, 100) / 100.0;
+
+    previousScore = score;
+
+    return elapsed >= s_cast(int64_t, softLimit * scale) || elapsed >= hardLimit;
+}
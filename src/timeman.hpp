@@ -0,0 +1,31 @@
+#pragma once
+#include <cstdint>
+
+#include "search.hpp"
+
+
+/*
+    Time management
+
+    hardLimit: the search is aborted once this much time has passed
+    softLimit: no new iteration is started past this, scaled by how
+               settled the search looks (best move stability, score drops)
+*/
+
+struct TimeManager
+{
+    int moveOverhead = Settings::defaultMoveOverhead;
+
+    bool isTimed      = false; // Any of movetime, wtime or btime given
+    bool usesClock    = false; // wtime/btime given, soft limit applies
+    int64_t softLimit = 0;
+    int64_t hardLimit = 0;
+
+    int bestMoveStability = 0;
+    int previousScore     = 0;
+
+    void init(const Search::Limits& limits, bool isWhite);
+
+    // Called after every completed iteration
+    [[nodiscard]] bool shouldStop(int64_t elapsed, int depth, int score, bool bestMoveChanged);
+};
@@ -0,0 +1,202 @@
+#include <algorithm>
+#include <limits>
+
+#include "transposition.hpp"
+#include "settings.hpp"
+
+
+namespace TT
+{
+
+    void Table::resize(size_t megabytes)
+    {
+        // Bucket count is kept a power of two so the index is a mask
+        size_t count = 1;
+        while (count * 2 * sizeof(Bucket) <= megabytes * 1024 * 1024)
+            count *= 2;
+
+        buckets     = std::make_unique<Bucket[]>(count);
+        bucketCount = count;
+        generation  = 0;
+    }
+
+
+    void Table::clear()
+    {
+        for (size_t i = 0; i < bucketCount; ++i) {
+            for (Entry& entry : buckets[i].entries) {
+                entry.keyXorData.store(0ULL, std::memory_order_relaxed);
+                entry.data.store(0ULL, std::memory_order_relaxed);
+            }
+        }
+
+        generation = 0;
+    }
+
+
+    bool Table::probe(uint64_t key, EntryData& entry)
+    {
+        Bucket& bucket = buckets[key & (bucketCount - 1)];
+
+        for (Entry& slot : bucket.entries) {
+            const uint64_t data = slot.data.load(std::memory_order_relaxed);
+
+            if (data && (slot.keyXorData.load(std::memory_order_relaxed) ^ data) == key) {
+                entry = EntryData::unpack(data);
+
+                // Used again in this search, so it isn't aged out like a stale entry. Both words are
+                // rewritten to keep the key check valid, a racing store just wins or loses as a whole
+                if (entry.generation() != generation) {
+                    EntryData refreshed = entry;
+                    refreshed.genBound  = s_cast(uint8_t, (generation << 2) | entry.bound());
+
+                    const uint64_t refreshedData = refreshed.pack();
+
+                    slot.keyXorData.store(key ^ refreshedData, std::memory_order_relaxed);
+                    slot.data.store(refreshedData, std::memory_order_relaxed);
+                }
+
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+
+    void Table::store(uint64_t key, int score, Bound bound, int depth, uint16_t move)
+    {
+        Bucket& bucket = buckets[key & (bucketCount - 1)];
+
+        Entry* replace = nullptr;
+        EntryData old  = {};
+
+        for (Entry& slot : bucket.entries) {
+            const uint64_t data = slot.data.load(std::memory_order_relaxed);
+
+            if (data && (slot.keyXorData.load(std::memory_order_relaxed) ^ data) == key) {
+                replace = &slot;
+                old     = EntryData::unpack(data);
+                break;
+            }
+        }
+
+        if (replace) {
+            // Don't let a shallow bound from the current search push out deeper data
+            if (bound != BOUND_EXACT && depth + 2 <= old.depth && old.generation() == generation)
+                return;
+
+            // Keep the old move if this search didn't find one
+            if (!move)
+                move = old.move;
+        }
+        else {
+            // Replace the shallowest entry, counting each search of age as 8 plies of depth
+            int replaceValue = std::numeric_limits<int>::max();
+
+            for (Entry& slot : bucket.entries) {
+                const EntryData data = EntryData::unpack(slot.data.load(std::memory_order_relaxed));
+                const int age        = (generation - data.generation()) & 63;
+                const int value      = data.depth - 8 * age;
+
+                if (value < replaceValue) {
+                    replaceValue = value;
+                    replace      = &slot;
+                }
+            }
+        }
+
+        const uint64_t data = EntryData{
+            .move     = move,
+            .score    = s_cast(int16_t, score),
+            .depth    = s_cast(uint8_t, depth),
+            .genBound = s_cast(uint8_t, (generation << 2) | bound)
+        }.pack();
+
+        replace->keyXorData.store(key ^ data, std::memory_order_relaxed);
+        replace->data.store(data, std::memory_order_relaxed);
+    }
+
+
+    int Table::hashfull() const
+    {
+        int used = 0;
+
+        const size_t sampled = std::min<size_t>(250, bucketCount);
+        for (size_t i = 0; i < sampled; ++i) {
+            for (const Entry& slot : buckets[i].entries) {
+                const EntryData data = EntryData::unpack(slot.data.load(std::memory_order_relaxed));
+
+                if (data.bound() != BOUND_NONE && data.generation() == generation)
+                    ++used;
+            }
+        }
+
+        return s_cast(int, used * 1000 / (sampled * 4));
+    }
+
+
+    int scoreToTT(int score, int ply)
+    {
+        if (score >= Settings::tbWinScore - Settings::maxPly)
+            return score + ply;
+        if (score <= -Settings::tbWinScore + Settings::maxPly)
+            return score - ply;
+
+        return score;
+    }
+
+
+    int scoreFromTT(int score, int ply)
+    {
+        if (score >= Settings::tbWinScore - Settings::maxPly)
+            return score - ply;
+        if (score <= -Settings::tbWinScore + Settings::maxPly)
+            return score + ply;
+
+        return score;
+    }
+
+
+
+    void PerftTable::resize(size_t megabytes)
+    {
+        size_t count = 1;
+        while (count * 2 * sizeof(Entry) <= megabytes * 1024 * 1024)
+            count *= 2;
+
+        entries    = std::make_unique<Entry[]>(count);
+        entryCount = count;
+    }
+
+
+    // Depths of the same position land in different slots
+    [[nodiscard]] static size_t perftIndex(const uint64_t key, const int depth, const size_t entryCount)
+    {
+        return (key ^ (s_cast(uint64_t, depth) * 0x9E3779B97F4A7C15ULL)) & (entryCount - 1);
+    }
+
+
+    bool PerftTable::probe(uint64_t key, int depth, uint64_t& nodes) const
+    {
+        const Entry& slot   = entries[perftIndex(key, depth, entryCount)];
+        const uint64_t data = slot.data.load(std::memory_order_relaxed);
+
+        if (!data || (data & 0xFF) != s_cast(uint64_t, depth) || (slot.keyXorData.load(std::memory_order_relaxed) ^ data) != key)
+            return false;
+
+        nodes = data >> 8;
+        return true;
+    }
+
+
+    void PerftTable::store(uint64_t key, int depth, uint64_t nodes)
+    {
+        Entry& slot         = entries[perftIndex(key, depth, entryCount)];
+        const uint64_t data = (nodes << 8) | s_cast(uint64_t, depth);
+
+        slot.keyXorData.store(key ^ data, std::memory_order_relaxed);
+        slot.data.store(data, std::memory_order_relaxed);
+    }
+
+}
@@ -0,0 +1,128 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "utils.hpp"
+#include "pieces.hpp"
+
+
+namespace TT
+{
+
+    enum Bound : uint8_t
+    {
+        BOUND_NONE  = 0,
+        BOUND_UPPER = 1, // Failed low, score is at most this
+        BOUND_LOWER = 2, // Failed high, score is at least this
+        BOUND_EXACT = 3
+    };
+
+
+    // What the table stores per position, packed into one 64-bit word
+    struct EntryData
+    {
+        uint16_t move    = 0; // Pieces::Move::data
+        int16_t score    = 0; // Mate scores stored relative to the node
+        uint8_t depth    = 0;
+        uint8_t genBound = 0; // generation << 2 | bound
+
+        [[nodiscard]] inline Bound bound() const { return s_cast(Bound, genBound & 3); }
+        [[nodiscard]] inline uint8_t generation() const { return genBound >> 2; }
+
+        [[nodiscard]] inline uint64_t pack() const
+        {
+            return s_cast(uint64_t, move) | (s_cast(uint64_t, s_cast(uint16_t, score)) << 16) |
+                   (s_cast(uint64_t, depth) << 32) | (s_cast(uint64_t, genBound) << 40);
+        }
+
+        [[nodiscard]] static inline EntryData unpack(const uint64_t data)
+        {
+            return EntryData{
+                .move     = s_cast(uint16_t, data),
+                .score    = s_cast(int16_t, s_cast(uint16_t, data >> 16)),
+                .depth    = s_cast(uint8_t, data >> 32),
+                .genBound = s_cast(uint8_t, data >> 40)
+            };
+        }
+    };
+
+
+    /*
+        Entry layout (16 bytes, 4 per cache line)
+
+            keyXorData   64   Zobrist key ^ data
+            data         64   packed EntryData, 0 when empty
+
+        All search threads share the table without locks. An entry torn by
+        two threads writing at once fails the key ^ data check and reads as
+        a miss instead of handing back another position's data.
+    */
+
+    struct Entry
+    {
+        std::atomic<uint64_t> keyXorData = 0ULL;
+        std::atomic<uint64_t> data       = 0ULL;
+    };
+
+
+    struct alignas(64) Bucket
+    {
+        Entry entries[4];
+    };
+
+
+    struct Table
+    {
+        std::unique_ptr<Bucket[]> buckets;
+        size_t bucketCount = 0;
+
+        uint8_t generation = 0;
+
+        void resize(size_t megabytes);
+        void clear();
+
+        // Next search, older entries become preferred for replacement
+        inline void newSearch() { generation = (generation + 1) & 63; }
+
+        // A hit from an older search is refreshed to the current generation
+        [[nodiscard]] bool probe(uint64_t key, EntryData& entry);
+        void store(uint64_t key, int score, Bound bound, int depth, uint16_t move);
+
+        // Permill of sampled entries written during the current search
+        [[nodiscard]] int hashfull() const;
+    };
+
+
+    inline Table table;
+
+
+    // Mate and tablebase scores are stored as distance from this node, not from the root
+    [[nodiscard]] int scoreToTT(int score, int ply);
+    [[nodiscard]] int scoreFromTT(int score, int ply);
+
+
+    /*
+        Perft cache, leaf counts by position and remaining depth
+
+            keyXorData   64   Zobrist key ^ data
+            data         64   count << 8 | depth
+
+        A slot per (key, depth), always replaced. Counts are only taken
+        for the exact key and depth, so hashed perft gives the same totals
+        as plain perft. Written like the main table, a slot torn by two
+        perft threads reads as a miss.
+    */
+
+    struct PerftTable
+    {
+        std::unique_ptr<Entry[]> entries;
+        size_t entryCount = 0;
+
+        void resize(size_t megabytes);
+
+        [[nodiscard]] bool probe(uint64_t key, int depth, uint64_t& nodes) const;
+        void store(uint64_t key, int depth, uint64_t nodes);
+    };
+
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include <cstdint>
+#include <chrono>
 #include <random>
 #include <string>
 
@@ -26,12 +27,33 @@ namespace Utils
     }
 
 
-    [[nodiscard]] inline uint64_t BitShift(uint64_t x, int shift)
+    // Milliseconds on a monotonic clock
+    [[nodiscard]] inline int64_t now()
     {
-        return ((shift > 0) ? (x << shift) : (x >> -shift));
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
     }
 
 
+    // xorshift64*, deterministic for a given seed
+    struct PRNG
+    {
+        uint64_t state;
+
+        [[nodiscard]] constexpr uint64_t next()
+        {
+            state ^= state >> 12;
+            state ^= state << 25;
+            state ^= state >> 27;
+            return state * 2685821657736338717ULL;
+        }
+
+        [[nodiscard]] constexpr uint64_t sparse()
+        {
+            return next() & next() & next();
+        }
+    };
+
+
     [[nodiscard]] inline bool isPieceWhite(int piece)
     {
         return !(piece & 1); // !(piece % 2)
@@ -48,16 +70,10 @@ namespace Utils
 
     [[nodiscard]] std::string toUCI(const Pieces::Move& move)
     {
-        std::string uci{
-            static_cast<char>('a' + (move.fromSquare % 8)),
-            static_cast<char>('1' + (move.fromSquare / 8)),
-            static_cast<char>('a' + (move.toSquare % 8)),
-            static_cast<char>('1' + (move.toSquare / 8))
-        };
+        std::string uci = toUCI(move.from()) + toUCI(move.to());
 
-        if (move.promotionPieceType != Pieces::PieceType::PIECE_TYPE_COUNT) {
-            uci += Pieces::getPieceTypeChar(move.promotionPieceType);
-        }
+        if (move.isPromotion())
+            uci += Pieces::getPieceTypeChar(move.promotionPieceType());
 
         return uci;
     }
@@ -68,19 +84,15 @@ namespace Utils
         return static_cast<uint8_t>((UCI_Square[1] - '1') * 8 + UCI_Square[0] - 'a');
     }
 
+    // Only the promotion flag can be read from the string, Engine::makeUCIMove finds the rest
     [[nodiscard]] Pieces::Move moveFromUCI(const std::string& UCI_Move)
     {
-        int promotionPieceType = Pieces::PieceType::PIECE_TYPE_COUNT;
+        Pieces::MoveFlag flag = Pieces::MoveFlag::NONE;
 
-        if (UCI_Move.length() == 5) {
-            promotionPieceType = Pieces::getPieceTypeFromChar(UCI_Move[4]);
-        }
+        if (UCI_Move.length() == 5)
+            flag = Pieces::Move::promotionFlag(Pieces::getPieceTypeFromChar(UCI_Move[4]));
 
-        return Pieces::Move{
-            static_cast<uint8_t>((UCI_Move[1] - '1') * 8 + UCI_Move[0] - 'a'),
-            static_cast<uint8_t>((UCI_Move[3] - '1') * 8 + UCI_Move[2] - 'a'),
-            promotionPieceType
-        };
+        return Pieces::Move(squareFromUCI(UCI_Move.substr(0, 2)), squareFromUCI(UCI_Move.substr(2, 2)), flag);
     }
 
 
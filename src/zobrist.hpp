@@ -0,0 +1,56 @@
+#pragma once
+#include <cstdint>
+
+#include "utils.hpp"
+#include "pieces.hpp"
+
+
+namespace Zobrist
+{
+
+    struct Keys
+    {
+        uint64_t pieces[Pieces::Piece::PIECE_COUNT][64] = {};
+        uint64_t castling[16]                          = {};
+        uint64_t enPassant[8]                          = {};
+        uint64_t blackToMove                           = 0ULL;
+    };
+
+
+    // Generated at compile time from a fixed seed
+    constexpr Keys keys = [] {
+        Keys k;
+        Utils::PRNG rng{1070372ULL};
+
+        for (auto& piece : k.pieces)
+            for (uint64_t& key : piece)
+                key = rng.next();
+
+        for (uint64_t& key : k.castling)
+            key = rng.next();
+
+        for (uint64_t& key : k.enPassant)
+            key = rng.next();
+
+        k.blackToMove = rng.next();
+
+        return k;
+    }();
+
+
+    [[nodiscard]] constexpr uint64_t piece(const int piece, const Square square)
+    {
+        return keys.pieces[piece][square];
+    }
+
+    [[nodiscard]] constexpr uint64_t castling(const char castlingFlags)
+    {
+        return keys.castling[castlingFlags & 15];
+    }
+
+    [[nodiscard]] constexpr uint64_t enPassant(const Square square)
+    {
+        return (square == 64) ? 0ULL : keys.enPassant[square % 8];
+    }
+
+}